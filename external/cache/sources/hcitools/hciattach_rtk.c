@@ -40,6 +40,7 @@
 #include <sys/uio.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <poll.h>
 
 #include <signal.h>
 #define Config_Android 0 /*1 for android; 0 for Linux*/
@@ -168,6 +169,10 @@ struct hci_ev_cmd_complete {
 
 #define PATCH_DATA_FIELD_MAX_SIZE          252
 #define READ_DATA_SIZE                     16
+#define PATCH_TIMEOUT_MS                   2000
+
+/* sliding window size requested in the h5 config message */
+#define H5_TX_WINDOW_MAX                   4
 
 /* HCI data types */
 #define H5_ACK_PKT                         0x00
@@ -302,6 +307,7 @@ struct rtk_h5_struct {
 	H5_LINK_STATE   link_estab_state;
 	struct sk_buff *rx_skb;
 	struct sk_buff *host_last_cmd;
+	uint8_t  tx_win;         /* negotiated sliding window size */
 };
 
 struct patch_struct {
@@ -309,6 +315,14 @@ struct patch_struct {
 	int nTotal;            /* total pkt number */
 	int nRxIndex;          /* ack index from board */
 	int nNeedRetry;        /* if no response from board */
+	int nRxCount;          /* number of acked pkts */
+	int nCredits;          /* Num_HCI_Command_Packets from board */
+};
+
+struct patch_frag {
+	uint8_t  index;
+	uint8_t  len;
+	uint8_t *data;
 };
 
 typedef struct {
@@ -967,6 +981,12 @@ static void hci_recv_frame(struct sk_buff *skb)
 			RS_DBG("Get CONFG pkt-active mode\n");
 		} else if (!memcmp(skb->data, h5confresp,  0x2)) {
 			RS_DBG("Get CONFG resp pkt-active mode\n");
+			/* window size is the smaller of both config fields */
+			if (skb->data_len > 2)
+				rtk_h5.tx_win = MIN(skb->data[2] & 0x07, H5_TX_WINDOW_MAX);
+			else
+				rtk_h5.tx_win = 1;
+			RS_DBG("H5 sliding window size %d\n", rtk_h5.tx_win);
 			rtk_h5.link_estab_state = H5_INIT;//H5_PATCH;
 			//rtk_send_pure_ack_down(serial_fd);
 		} else {
@@ -986,13 +1006,23 @@ static void hci_recv_frame(struct sk_buff *skb)
 		rtk_send_pure_ack_down(serial_fd);
 		skb_free(skb);
 	} else if (rtk_h5.link_estab_state == H5_PATCH) {  /* patch */
-		rtk_patch.nRxIndex = skb->data[6];
-		if (rtk_patch.nRxIndex & 0x80)
-			rtk_patch.nRxIndex &= ~0x80;
-
-		RS_DBG("rtk_patch.nRxIndex %d\n", rtk_patch.nRxIndex);
-		if (rtk_patch.nRxIndex == rtk_patch.nTotal)
-			rtk_h5.link_estab_state = H5_ACTIVE;
+		if (skb->data[0] == cmd_complete_evt_code &&
+				skb->data[3] == 0x00 && skb->data[4] == 0x00) {
+			/* NOP command complete: the board grants credits only */
+			rtk_patch.nCredits = skb->data[2];
+		} else if (skb->data[0] == cmd_complete_evt_code &&
+				skb->data[3] == 0x20 && skb->data[4] == 0xfc) {
+			rtk_patch.nCredits = skb->data[2];
+			rtk_patch.nRxIndex = skb->data[6];
+			if (rtk_patch.nRxIndex & 0x80)
+				rtk_patch.nRxIndex &= ~0x80;
+			rtk_patch.nRxCount++;
+
+			RS_DBG("rtk_patch.nRxIndex %d\n", rtk_patch.nRxIndex);
+			/* indexes wrap at 0x80, so count the acked pkts */
+			if (rtk_patch.nRxCount == rtk_patch.nTotal + 1)
+				rtk_h5.link_estab_state = H5_ACTIVE;
+		}
 		skb_free(skb);
 	} else {
 		RS_ERR("receive packets in active state");
@@ -1307,160 +1337,220 @@ static void h5_tinit_sig_alarm(int sig)
 }
 
 /**
-* Retry to download patch when timeout in h5 proto, max retry times is 10.
-*
-* @warning Each time to retry, the time for timeout will be set as 3s.
-*
-* @param sig signaction for timeout
+* Build the h5 packet of a patch fragment, as vendor command 0xfc20
 *
+* @param frag patch fragment
+* @return socket buff after prepare in h5 proto
 */
-static void h5_tpatch_sig_alarm(int sig)
+static struct sk_buff *h5_prepare_patch_pkt(const struct patch_frag *frag)
 {
-	static int retries;
-	if (retries < h5_max_retries) {
-		RS_DBG("patch timerout, retry:\n");
-		if (rtk_h5.host_last_cmd) {
-			write(serial_fd, rtk_h5.host_last_cmd->data, rtk_h5.host_last_cmd->data_len);
-			RS_DBG("3-wire download patch re send:%d", retries);
-		}
-		retries++;
-		alarm(3);
-		return;
-	}
-	RS_ERR("H5 patch timed out\n");
-	exit(1);
+	uint8_t hcipatch[256] = {0x20, 0xfc, 00};
+
+	hcipatch[2] = frag->len + 1;
+	hcipatch[3] = frag->index;
+	if (frag->data != NULL)
+		memcpy(hcipatch + 4, frag->data, frag->len);
+
+	return h5_prepare_pkt(&rtk_h5, hcipatch, frag->len + 4, HCI_COMMAND_PKT); /* data: len + head: 4 */
 }
 
 /**
-* Download patch using hci. For h5 proto, not recv reply for 2s will timeout.
-* Call h5_tpatch_sig_alarm for retry.
+* Download patch using hci in h5 proto. Up to the negotiated h5 window size
+* of reliable packets are kept in flight, limited by the command credits
+* reported by the controller. Unacked packets are resent if no reply
+* arrives within PATCH_TIMEOUT_MS.
 *
 * @param dd uart file descriptor
-* @param index current index
-* @param data point to the config file
-* @param len current buf length
+* @param frags patch fragments
+* @param count number of fragments
+* @param ti termios struct, applied after the last fragment is sent
 * @return #0 on success
 *
 */
-static int hci_download_patch(int dd, int index, uint8_t *data, int len, struct termios *ti)
+static int hci_download_patch(int dd, const struct patch_frag *frags, int count, struct termios *ti)
 {
-	uint8_t hcipatch[256] = {0x20, 0xfc, 00};
+	struct sk_buff **sent;
 	char bytes[READ_DATA_SIZE];
-	int retlen;
-	struct sigaction sa;
+	struct pollfd pfd;
+	int next = 0, done, window, retries = 0;
+	int retlen, ret = -1, i;
 
-	sa.sa_handler = h5_tpatch_sig_alarm;
-	sigaction(SIGALRM, &sa, NULL);
-	alarm(2);
+	sent = calloc(count, sizeof(*sent));
+	if (!sent)
+		return -1;
 
-	download_vendor_patch_cp cp;
-	memset(&cp, 0, sizeof(cp));
-	cp.index = index;
-	if (data != NULL) {
-		memcpy(cp.data, data, len);
-	}
+	/* start with a single packet until the board reports its credits */
+	rtk_patch.nRxCount = 0;
+	rtk_patch.nCredits = 1;
 
-	int nValue = rtk_patch.nTotal|0x80;
-	if (index == nValue) {
-		rtk_patch.nTxIndex = rtk_patch.nTotal;
-	} else {
-		rtk_patch.nTxIndex = index;
-	}
-	hcipatch[2] = len+1;
-	memcpy(hcipatch+3, &cp, len+1);
+	pfd.fd = dd;
+	pfd.events = POLLIN;
 
-	struct sk_buff *nskb = h5_prepare_pkt(&rtk_h5, hcipatch, len+4, HCI_COMMAND_PKT); /* data: len + head: 4 */
+	while (rtk_patch.nRxCount < count) {
+		done = rtk_patch.nRxCount;
+		/* no credits: send nothing until an event grants some */
+		window = MIN(rtk_h5.tx_win, rtk_patch.nCredits);
 
-	if (rtk_h5.host_last_cmd) {
-		skb_free(rtk_h5.host_last_cmd);
-		rtk_h5.host_last_cmd = NULL;
-	}
+		while (next < count && next - done < window) {
+			sent[next] = h5_prepare_patch_pkt(&frags[next]);
+			if (!sent[next])
+				goto out;
 
-	rtk_h5.host_last_cmd = nskb;
+			if (frags[next].index & 0x80)
+				rtk_patch.nTxIndex = rtk_patch.nTotal;
+			else
+				rtk_patch.nTxIndex = frags[next].index;
 
-	len = write(dd, nskb->data, nskb->data_len);
-	RS_DBG("hci_download_patch nTxIndex:%d nRxIndex: %d\n", rtk_patch.nTxIndex, rtk_patch.nRxIndex);
+			write(dd, sent[next]->data, sent[next]->data_len);
+			RS_DBG("hci_download_patch nTxIndex:%d nRxIndex: %d\n", rtk_patch.nTxIndex, rtk_patch.nRxIndex);
 
-	if (index & 0x80) {
-		RS_DBG("Hw Flow Control enable after last command sent before last event recv ! ");
-		if (tcsetattr(dd, TCSADRAIN, ti) < 0) {
-			RS_ERR("Can't set port settings");
-			return -1;
+			if (frags[next].index & 0x80) {
+				RS_DBG("Hw Flow Control enable after last command sent before last event recv ! ");
+				if (tcsetattr(dd, TCSADRAIN, ti) < 0) {
+					RS_ERR("Can't set port settings");
+					goto out;
+				}
+			}
+			next++;
+		}
+
+		/* window closed, ack received events without piggybacking */
+		if (rtk_h5.is_txack_req)
+			rtk_send_pure_ack_down(dd);
+
+		retlen = poll(&pfd, 1, PATCH_TIMEOUT_MS);
+		if (retlen < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll fail");
+			goto out;
+		}
+
+		if (retlen == 0) {
+			if (++retries > h5_max_retries) {
+				RS_ERR("H5 patch timed out\n");
+				goto out;
+			}
+
+			RS_DBG("patch timeout, resend %d pkts, retry:%d", next - done, retries);
+			for (i = done; i < next; i++)
+				write(dd, sent[i]->data, sent[i]->data_len);
+			continue;
 		}
-	}
 
-	while (rtk_patch.nRxIndex != rtk_patch.nTxIndex) {  /* receive data and wait last pkt */
 		retlen = read_check(dd, &bytes, READ_DATA_SIZE);
 		if (retlen == -1) {
 			perror("read fail");
-			return -1;
+			goto out;
 		}
 		h5_recv(&rtk_h5, &bytes, retlen);
+
+		if (rtk_patch.nRxCount > done)
+			retries = 0;
+
+		for (i = done; i < rtk_patch.nRxCount && i < next; i++) {
+			skb_free(sent[i]);
+			sent[i] = NULL;
+		}
 	}
 
-	alarm(0);
-	return 0;
+	ret = 0;
+
+out:
+	for (i = 0; i < count; i++)
+		skb_free(sent[i]);
+	free(sent);
+
+	return ret;
 }
 
 /**
-* Download h4 patch
+* Download h4 patch. Commands are pipelined up to the Num_HCI_Command_Packets
+* reported by the controller in its command complete events.
 *
 * @param dd uart file descriptor
-* @param index current index
-* @param data point to the config file
-* @param len current buf length
-* @return ret_index
+* @param frags patch fragments
+* @param count number of fragments
+* @return #0 on success
 *
 */
-static int hci_download_patch_h4(int dd, int index, uint8_t *data, int len)
+static int hci_download_patch_h4(int dd, const struct patch_frag *frags, int count)
 {
-	 char bytes[257] = {0};
-	 char buf[257] = {0x01, 0x20, 0xfc, 00};
+	uint8_t buf[PATCH_DATA_FIELD_MAX_SIZE + 5] = {0x01, 0x20, 0xfc, 00};
+	uint8_t bytes[3 + 255];
+	struct pollfd pfd;
+	int next = 0, done = 0, credits = 1;
+	int len = 0, res, plen;
+
+	pfd.fd = dd;
+	pfd.events = POLLIN;
+
+	while (done < count) {
+		while (next < count && next - done < credits) {
+			/* Set data struct. */
+			buf[3] = frags[next].len + 1; /* add index */
+			buf[4] = frags[next].index;
+			if (NULL != frags[next].data)
+				memcpy(&buf[5], frags[next].data, frags[next].len);
+
+			res = write(dd, buf, frags[next].len + 5);
+			RS_DBG("h4 write index:%d with len: %d.\n", frags[next].index, res);
+			next++;
+		}
 
-	RS_DBG("dd:%d, index:%d, len:%d", dd, index, len);
-	if (NULL != data) {
-		memcpy(&buf[5], data, len);
-	}
+		res = poll(&pfd, 1, PATCH_TIMEOUT_MS);
+		if (res < 0 && errno == EINTR)
+			continue;
+		if (res <= 0) {
+			RS_ERR("h4 patch event timed out");
+			return -1;
+		}
 
-	int cur_index = index;
-	int ret_Index = -1;
+		res = read(dd, bytes + len, sizeof(bytes) - len);
+		if (res <= 0) {
+			RS_ERR("h4 read fail");
+			return -1;
+		}
+		len += res;
+
+		/* parse all complete events received so far */
+		while (len >= 3) {
+			if (bytes[0] != 0x04) {
+				memmove(bytes, bytes + 1, --len);
+				continue;
+			}
 
-	/* Set data struct. */
-	buf[3] = len + 1; /* add index */
-	buf[4] = cur_index;
-	size_t total_len = len + 5;
+			plen = bytes[2];
+			if (len < plen + 3)
+				break;
 
-	/* write */
-	uint16_t w_len;
-	w_len = write(dd, buf, total_len);
-	RS_DBG("h4 write success with len: %d.\n", w_len);
+			if ((0x0e == bytes[1]) && (plen >= 3) && (0x00 == bytes[4]) && (0x00 == bytes[5])) {
+				/* NOP command complete: the board grants credits only */
+				credits = bytes[3];
+			} else if ((0x0e == bytes[1]) && (plen >= 5) && (0x20 == bytes[4]) && (0xfc == bytes[5])) {
+				RS_DBG("---->ret_Index:%d, ----->rstatus:%d\n", bytes[7], bytes[6]);
+				if (0x00 != bytes[6]) {
+					RS_ERR("---->read event status is wrong.\n");
+					return -1;
+				}
 
-	uint16_t res;
-	res = read(dd, bytes, 8);
+				/* check index but ignore last pkt */
+				if ((bytes[7] != frags[done].index) && (done != count - 1)) {
+					RS_DBG("index mismatch i:%d iCurIndex:%d, patch fail\n", done, bytes[7]);
+					return -1;
+				}
 
-	if (DBG_ON) {
-		RS_DBG("h4 read success with len: %d.\n", res);
-		int i = 0;
-		for (i = 0; i < 8; i++) {
-			fprintf(stderr, "byte[%d] = 0x%x\n", i, bytes[i]);
-		}
-	}
+				/* ncmd 0: hold further fragments until a later event grants credits */
+				credits = bytes[3];
+				done++;
+			}
 
-	uint8_t rstatus;
-	if ((0x04 == bytes[0]) && (0x20 == bytes[4]) && (0xfc == bytes[5])) {
-		ret_Index = bytes[7];
-		rstatus = bytes[6];
-		RS_DBG("---->ret_Index:%d, ----->rstatus:%d\n", ret_Index, rstatus);
-		if (0x00 != rstatus) {
-			RS_ERR("---->read event status is wrong.\n");
-			return -1;
+			len -= plen + 3;
+			memmove(bytes, bytes + plen + 3, len);
 		}
-	} else {
-		RS_ERR("==========>Didn't read curret data.\n");
-		return -1;
 	}
 
-	return ret_Index;
+	return 0;
 }
 
 /**
@@ -1881,6 +1971,9 @@ static void rtk_download_fw_config(int fd, uint8_t *buf, size_t filesize, int is
 	uint8_t iTotalIndex = 0;
 	uint8_t iCmdSentNum = 0;   /* the number of CMDs which have been sent */
 	uint8_t *bufpatch;
+	struct patch_frag *frags;
+	struct timespec start, end;
+	int ret = -1;
 
 	iEndIndex = (uint8_t)((filesize-1)/PATCH_DATA_FIELD_MAX_SIZE);
 	iLastPacketLen = (filesize)%PATCH_DATA_FIELD_MAX_SIZE;
@@ -1905,6 +1998,12 @@ static void rtk_download_fw_config(int fd, uint8_t *buf, size_t filesize, int is
 
 	bufpatch = buf;
 
+	frags = calloc(iTotalIndex + 1, sizeof(*frags));
+	if (!frags) {
+		RS_ERR("Can't alloc patch fragments");
+		return;
+	}
+
 	int i;
 	for (i = 0; i <= iTotalIndex; i++) {
 		if (iCurIndex < iEndIndex) {
@@ -1929,15 +2028,9 @@ static void rtk_download_fw_config(int fd, uint8_t *buf, size_t filesize, int is
 		if (iCurIndex & 0x80)
 			RS_DBG("Send FW last command");
 
-		if (proto == HCI_UART_H4) {
-			iCurIndex = hci_download_patch_h4(fd, iCurIndex, bufpatch, iCurLen);
-			if ((iCurIndex != i) && (i != rtk_patch.nTotal)) {
-				/* check index but ignore last pkt */
-				RS_DBG("index mismatch i:%d iCurIndex:%d, patch fail\n", i, iCurIndex);
-				return;
-			}
-		} else if (proto == HCI_UART_3WIRE)
-			hci_download_patch(fd, iCurIndex, bufpatch, iCurLen, ti);
+		frags[i].index = iCurIndex;
+		frags[i].len = iCurLen;
+		frags[i].data = bufpatch;
 
 		if (iCurIndex < iEndIndex) {
 			bufpatch += PATCH_DATA_FIELD_MAX_SIZE;
@@ -1945,6 +2038,20 @@ static void rtk_download_fw_config(int fd, uint8_t *buf, size_t filesize, int is
 		iCurIndex++;
 	}
 
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (proto == HCI_UART_H4)
+		ret = hci_download_patch_h4(fd, frags, iTotalIndex + 1);
+	else if (proto == HCI_UART_3WIRE)
+		ret = hci_download_patch(fd, frags, iTotalIndex + 1, ti);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	RS_DBG("Patch download %s, %d pkts in %ld ms", ret < 0 ? "failed" : "done",
+			iTotalIndex + 1, (long)((end.tv_sec - start.tv_sec) * 1000 +
+				(end.tv_nsec - start.tv_nsec) / 1000000));
+
+	free(frags);
+
 	/* set last ack packet down */
 	if (proto == HCI_UART_3WIRE) {
 		rtk_send_pure_ack_down(fd);
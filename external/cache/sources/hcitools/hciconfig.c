@@ -661,6 +661,22 @@ static void cmd_features(int ctl, int hdev, char *opt)
 	hci_close_dev(dd);
 }
 
+/* name holds up to 248 characters plus the terminating nul */
+static void print_local_name(char *name)
+{
+	int i;
+
+	for (i = 0; i < 248 && name[i]; i++) {
+		if ((unsigned char) name[i] < 32 || name[i] == 127)
+			name[i] = '.';
+	}
+
+	name[248] = '\0';
+
+	print_dev_hdr(&di);
+	printf("\tName: '%s'\n", name);
+}
+
 static void cmd_name(int ctl, int hdev, char *opt)
 {
 	int dd;
@@ -680,7 +696,6 @@ static void cmd_name(int ctl, int hdev, char *opt)
 		}
 	} else {
 		char name[249];
-		int i;
 
 		if (hci_read_local_name(dd, sizeof(name), name, 1000) < 0) {
 			fprintf(stderr, "Can't read local name on hci%d: %s (%d)\n",
@@ -688,15 +703,7 @@ static void cmd_name(int ctl, int hdev, char *opt)
 			exit(1);
 		}
 
-		for (i = 0; i < 248 && name[i]; i++) {
-			if ((unsigned char) name[i] < 32 || name[i] == 127)
-				name[i] = '.';
-		}
-
-		name[248] = '\0';
-
-		print_dev_hdr(&di);
-		printf("\tName: '%s'\n", name);
+		print_local_name(name);
 	}
 
 	hci_close_dev(dd);
@@ -900,7 +907,7 @@ static char *get_minor_device_name(int major, int minor)
 	return "Unknown (reserved) minor device class";
 }
 
-static void cmd_class(int ctl, int hdev, char *opt)
+static void print_class(uint8_t *cls)
 {
 	static const char *services[] = { "Positioning",
 					"Networking",
@@ -918,6 +925,32 @@ static void cmd_class(int ctl, int hdev, char *opt)
 					"Peripheral",
 					"Imaging",
 					"Uncategorized" };
+
+	print_dev_hdr(&di);
+	printf("\tClass: 0x%02x%02x%02x\n", cls[2], cls[1], cls[0]);
+	printf("\tService Classes: ");
+	if (cls[2]) {
+		unsigned int i;
+		int first = 1;
+		for (i = 0; i < (sizeof(services) / sizeof(*services)); i++)
+			if (cls[2] & (1 << i)) {
+				if (!first)
+					printf(", ");
+				printf("%s", services[i]);
+				first = 0;
+			}
+	} else
+		printf("Unspecified");
+	printf("\n\tDevice Class: ");
+	if ((cls[1] & 0x1f) >= sizeof(major_devices) / sizeof(*major_devices))
+		printf("Invalid Device Class!\n");
+	else
+		printf("%s, %s\n", major_devices[cls[1] & 0x1f],
+			get_minor_device_name(cls[1] & 0x1f, cls[0] >> 2));
+}
+
+static void cmd_class(int ctl, int hdev, char *opt)
+{
 	int s = hci_open_dev(hdev);
 
 	if (s < 0) {
@@ -939,27 +972,7 @@ static void cmd_class(int ctl, int hdev, char *opt)
 						hdev, strerror(errno), errno);
 			exit(1);
 		}
-		print_dev_hdr(&di);
-		printf("\tClass: 0x%02x%02x%02x\n", cls[2], cls[1], cls[0]);
-		printf("\tService Classes: ");
-		if (cls[2]) {
-			unsigned int i;
-			int first = 1;
-			for (i = 0; i < (sizeof(services) / sizeof(*services)); i++)
-				if (cls[2] & (1 << i)) {
-					if (!first)
-						printf(", ");
-					printf("%s", services[i]);
-					first = 0;
-				}
-		} else
-			printf("Unspecified");
-		printf("\n\tDevice Class: ");
-		if ((cls[1] & 0x1f) >= sizeof(major_devices) / sizeof(*major_devices))
-			printf("Invalid Device Class!\n");
-		else
-			printf("%s, %s\n", major_devices[cls[1] & 0x1f],
-				get_minor_device_name(cls[1] & 0x1f, cls[0] >> 2));
+		print_class(cls);
 	}
 }
 
@@ -1125,10 +1138,34 @@ static void cmd_commands(int ctl, int hdev, char *opt)
 	hci_close_dev(dd);
 }
 
+static void print_version(struct hci_version *ver)
+{
+	char *hciver, *lmpver;
+
+	hciver = hci_vertostr(ver->hci_ver);
+	if (((di.type & 0x30) >> 4) == HCI_BREDR)
+		lmpver = lmp_vertostr(ver->lmp_ver);
+	else
+		lmpver = pal_vertostr(ver->lmp_ver);
+
+	print_dev_hdr(&di);
+	printf("\tHCI Version: %s (0x%x)  Revision: 0x%x\n"
+		"\t%s Version: %s (0x%x)  Subversion: 0x%x\n"
+		"\tManufacturer: %s (%d)\n",
+		hciver ? hciver : "n/a", ver->hci_ver, ver->hci_rev,
+		(((di.type & 0x30) >> 4) == HCI_BREDR) ? "LMP" : "PAL",
+		lmpver ? lmpver : "n/a", ver->lmp_ver, ver->lmp_subver,
+		bt_compidtostr(ver->manufacturer), ver->manufacturer);
+
+	if (hciver)
+		bt_free(hciver);
+	if (lmpver)
+		bt_free(lmpver);
+}
+
 static void cmd_version(int ctl, int hdev, char *opt)
 {
 	struct hci_version ver;
-	char *hciver, *lmpver;
 	int dd;
 
 	dd = hci_open_dev(hdev);
@@ -1144,25 +1181,7 @@ static void cmd_version(int ctl, int hdev, char *opt)
 		exit(1);
 	}
 
-	hciver = hci_vertostr(ver.hci_ver);
-	if (((di.type & 0x30) >> 4) == HCI_BREDR)
-		lmpver = lmp_vertostr(ver.lmp_ver);
-	else
-		lmpver = pal_vertostr(ver.lmp_ver);
-
-	print_dev_hdr(&di);
-	printf("\tHCI Version: %s (0x%x)  Revision: 0x%x\n"
-		"\t%s Version: %s (0x%x)  Subversion: 0x%x\n"
-		"\tManufacturer: %s (%d)\n",
-		hciver ? hciver : "n/a", ver.hci_ver, ver.hci_rev,
-		(((di.type & 0x30) >> 4) == HCI_BREDR) ? "LMP" : "PAL",
-		lmpver ? lmpver : "n/a", ver.lmp_ver, ver.lmp_subver,
-		bt_compidtostr(ver.manufacturer), ver.manufacturer);
-
-	if (hciver)
-		bt_free(hciver);
-	if (lmpver)
-		bt_free(lmpver);
+	print_version(&ver);
 
 	hci_close_dev(dd);
 }
@@ -1863,6 +1882,104 @@ static void print_dev_hdr(struct hci_dev_info *di)
 						di->sco_mtu, di->sco_pkts);
 }
 
+static void read_done(int err, struct hci_request *r, void *user_data)
+{
+	*((int *) user_data) = err;
+}
+
+static void queue_read(struct hci_cmd_queue *q, struct hci_request *rq,
+			uint16_t ogf, uint16_t ocf, void *rp, int rlen,
+			int *err)
+{
+	memset(rq, 0, sizeof(*rq));
+	rq->ogf    = ogf;
+	rq->ocf    = ocf;
+	rq->rparam = rp;
+	rq->rlen   = rlen;
+
+	*err = ECANCELED;
+	if (hci_cmd_queue_send(q, rq, 1000, read_done, err) < 0)
+		*err = errno;
+}
+
+static void check_read(int err, uint8_t status, int hdev, const char *what)
+{
+	if (!err && status)
+		err = EIO;
+
+	if (!err)
+		return;
+
+	fprintf(stderr, "Can't read %s on hci%d: %s (%d)\n",
+					what, hdev, strerror(err), err);
+	exit(1);
+}
+
+/* Name, class and version of an up device are read through one command
+ * queue so they share a descriptor and event filter and go out together
+ * as far as the controller grants command credits. */
+static void print_local_info(struct hci_dev_info *di)
+{
+	int bredr = ((di->type & 0x30) >> 4) == HCI_BREDR;
+	struct hci_request name_rq, class_rq, ver_rq;
+	read_local_name_rp name_rp;
+	read_class_of_dev_rp class_rp;
+	read_local_version_rp ver_rp;
+	struct hci_version ver;
+	int name_err = 0, class_err = 0, ver_err;
+	struct hci_cmd_queue *q;
+	int dd;
+
+	dd = hci_open_dev(di->dev_id);
+	if (dd < 0) {
+		fprintf(stderr, "Can't open device hci%d: %s (%d)\n",
+					di->dev_id, strerror(errno), errno);
+		exit(1);
+	}
+
+	q = hci_cmd_queue_new(dd);
+	if (!q) {
+		fprintf(stderr, "Can't open command queue on hci%d: %s (%d)\n",
+					di->dev_id, strerror(errno), errno);
+		exit(1);
+	}
+
+	if (bredr) {
+		queue_read(q, &name_rq, OGF_HOST_CTL, OCF_READ_LOCAL_NAME,
+				&name_rp, READ_LOCAL_NAME_RP_SIZE, &name_err);
+		queue_read(q, &class_rq, OGF_HOST_CTL, OCF_READ_CLASS_OF_DEV,
+				&class_rp, READ_CLASS_OF_DEV_RP_SIZE, &class_err);
+	}
+
+	queue_read(q, &ver_rq, OGF_INFO_PARAM, OCF_READ_LOCAL_VERSION,
+				&ver_rp, READ_LOCAL_VERSION_RP_SIZE, &ver_err);
+
+	/* Whatever a failed flush leaves behind is cancelled by the free */
+	hci_cmd_queue_flush(q);
+	hci_cmd_queue_free(q);
+	hci_close_dev(dd);
+
+	if (bredr) {
+		char name[249];
+
+		check_read(name_err, name_rp.status, di->dev_id, "local name");
+		memcpy(name, name_rp.name, 248);
+		print_local_name(name);
+
+		check_read(class_err, class_rp.status, di->dev_id,
+							"class of device");
+		print_class(class_rp.dev_class);
+	}
+
+	check_read(ver_err, ver_rp.status, di->dev_id, "version info");
+	ver.manufacturer = btohs(ver_rp.manufacturer);
+	ver.hci_ver      = ver_rp.hci_ver;
+	ver.hci_rev      = btohs(ver_rp.hci_rev);
+	ver.lmp_ver      = ver_rp.lmp_ver;
+	ver.lmp_subver   = btohs(ver_rp.lmp_subver);
+	print_version(&ver);
+}
+
 static void print_dev_info(int ctl, struct hci_dev_info *di)
 {
 	struct hci_dev_stats *st = &di->stat;
@@ -1887,15 +2004,10 @@ static void print_dev_info(int ctl, struct hci_dev_info *di)
 			print_pkt_type(di);
 			print_link_policy(di);
 			print_link_mode(di);
-
-			if (hci_test_bit(HCI_UP, &di->flags)) {
-				cmd_name(ctl, di->dev_id, NULL);
-				cmd_class(ctl, di->dev_id, NULL);
-			}
 		}
 
 		if (hci_test_bit(HCI_UP, &di->flags))
-			cmd_version(ctl, di->dev_id, NULL);
+			print_local_info(di);
 	}
 
 	printf("\n");
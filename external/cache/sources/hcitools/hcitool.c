@@ -38,7 +38,9 @@
 #include <sys/param.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/poll.h>
 #include <signal.h>
+#include <time.h>
 
 //#include <glib.h>
 
@@ -559,6 +561,104 @@ static void cmd_inq(int dev_id, int argc, char **argv)
 	bt_free(info);
 }
 
+/* Remote device information, shared by scan and info */
+
+struct remote_info {
+	evt_remote_name_req_complete name;
+	evt_read_remote_version_complete ver;
+	evt_read_remote_features_complete feat;
+	int name_err;
+	int ver_err;
+	int feat_err;
+};
+
+static void remote_info_done(int err, struct hci_request *r, void *user_data)
+{
+	*((int *) user_data) = err;
+}
+
+static void queue_remote_req(struct hci_cmd_queue *q, struct hci_request *rq,
+				int to, int *err)
+{
+	*err = ECANCELED;
+	if (hci_cmd_queue_send(q, rq, to, remote_info_done, err) < 0)
+		*err = errno;
+}
+
+/* Name, version and features each end with their own event, so they
+ * are queued together and the baseband round trips overlap instead of
+ * running back to back. */
+static void read_remote_info(int dd, const bdaddr_t *bdaddr,
+				uint8_t pscan_rep_mode, uint16_t clkoffset,
+				uint16_t handle, int to,
+				struct remote_info *info)
+{
+	remote_name_req_cp name_cp;
+	read_remote_version_cp ver_cp;
+	read_remote_features_cp feat_cp;
+	struct hci_request name_rq, ver_rq, feat_rq;
+	struct hci_cmd_queue *q;
+
+	q = hci_cmd_queue_new(dd);
+	if (!q) {
+		info->name_err = info->ver_err = info->feat_err = errno;
+		return;
+	}
+
+	memset(&name_cp, 0, sizeof(name_cp));
+	bacpy(&name_cp.bdaddr, bdaddr);
+	name_cp.pscan_rep_mode = pscan_rep_mode;
+	name_cp.clock_offset   = clkoffset;
+
+	memset(&name_rq, 0, sizeof(name_rq));
+	name_rq.ogf    = OGF_LINK_CTL;
+	name_rq.ocf    = OCF_REMOTE_NAME_REQ;
+	name_rq.cparam = &name_cp;
+	name_rq.clen   = REMOTE_NAME_REQ_CP_SIZE;
+	name_rq.event  = EVT_REMOTE_NAME_REQ_COMPLETE;
+	name_rq.rparam = &info->name;
+	name_rq.rlen   = EVT_REMOTE_NAME_REQ_COMPLETE_SIZE;
+
+	memset(&ver_cp, 0, sizeof(ver_cp));
+	ver_cp.handle = handle;
+
+	memset(&ver_rq, 0, sizeof(ver_rq));
+	ver_rq.ogf    = OGF_LINK_CTL;
+	ver_rq.ocf    = OCF_READ_REMOTE_VERSION;
+	ver_rq.event  = EVT_READ_REMOTE_VERSION_COMPLETE;
+	ver_rq.cparam = &ver_cp;
+	ver_rq.clen   = READ_REMOTE_VERSION_CP_SIZE;
+	ver_rq.rparam = &info->ver;
+	ver_rq.rlen   = EVT_READ_REMOTE_VERSION_COMPLETE_SIZE;
+
+	memset(&feat_cp, 0, sizeof(feat_cp));
+	feat_cp.handle = handle;
+
+	memset(&feat_rq, 0, sizeof(feat_rq));
+	feat_rq.ogf    = OGF_LINK_CTL;
+	feat_rq.ocf    = OCF_READ_REMOTE_FEATURES;
+	feat_rq.event  = EVT_READ_REMOTE_FEATURES_COMPLETE;
+	feat_rq.cparam = &feat_cp;
+	feat_rq.clen   = READ_REMOTE_FEATURES_CP_SIZE;
+	feat_rq.rparam = &info->feat;
+	feat_rq.rlen   = EVT_READ_REMOTE_FEATURES_COMPLETE_SIZE;
+
+	queue_remote_req(q, &name_rq, to, &info->name_err);
+	queue_remote_req(q, &ver_rq, 20000, &info->ver_err);
+	queue_remote_req(q, &feat_rq, 20000, &info->feat_err);
+
+	/* Whatever a failed flush leaves behind is cancelled by the free */
+	hci_cmd_queue_flush(q);
+	hci_cmd_queue_free(q);
+
+	if (!info->name_err && info->name.status)
+		info->name_err = EIO;
+	if (!info->ver_err && info->ver.status)
+		info->ver_err = EIO;
+	if (!info->feat_err && info->feat.status)
+		info->feat_err = EIO;
+}
+
 /* Device scanning */
 
 static struct option scan_options[] = {
@@ -587,7 +687,7 @@ static void cmd_scan(int dev_id, int argc, char **argv)
 	int num_rsp, length, flags;
 	uint8_t cls[3], features[8];
 	char addr[18], name[249], *comp, *tmp;
-	struct hci_version version;
+	struct remote_info rinfo;
 	struct hci_dev_info di;
 	struct hci_conn_info_req *cr;
 	int refresh = 0, extcls = 0, extinf = 0, extoui = 0;
@@ -769,11 +869,29 @@ static void cmd_scan(int dev_id, int argc, char **argv)
 		}
 
 		if (handle > 0 || !nc) {
-			if (hci_read_remote_name_with_clock_offset(dd,
+			int err;
+
+			/* handle is only set with --info, where the name is
+			 * read together with the version and features */
+			if (handle > 0) {
+				read_remote_info(dd, &(info+i)->bdaddr,
+					(info+i)->pscan_rep_mode,
+					(info+i)->clock_offset | 0x8000,
+					handle, 100000, &rinfo);
+				err = rinfo.name_err;
+				if (!err) {
+					rinfo.name.name[247] = '\0';
+					strncpy(name, (char *) rinfo.name.name,
+								sizeof(name));
+				}
+			} else
+				err = hci_read_remote_name_with_clock_offset(dd,
 					&(info+i)->bdaddr,
 					(info+i)->pscan_rep_mode,
 					(info+i)->clock_offset | 0x8000,
-					sizeof(name), name, 100000) < 0) {
+					sizeof(name), name, 100000) < 0;
+
+			if (err) {
 				if (!nc)
 					strcpy(name, "n/a");
 			} else {
@@ -802,20 +920,24 @@ static void cmd_scan(int dev_id, int argc, char **argv)
 		}
 
 		if (extinf && handle > 0) {
-			if (hci_read_remote_version(dd, handle, &version, 20000) == 0) {
-				char *ver = lmp_vertostr(version.lmp_ver);
+			if (!rinfo.ver_err) {
+				char *ver = lmp_vertostr(rinfo.ver.lmp_ver);
+				uint16_t manufacturer = btohs(rinfo.ver.manufacturer);
 				printf("Manufacturer:\t%s (%d)\n",
-					bt_compidtostr(version.manufacturer),
-					version.manufacturer);
+					bt_compidtostr(manufacturer),
+					manufacturer);
 				printf("LMP version:\t%s (0x%x) [subver 0x%x]\n",
-					ver ? ver : "n/a",
-					version.lmp_ver, version.lmp_subver);
+					ver ? ver : "n/a", rinfo.ver.lmp_ver,
+					btohs(rinfo.ver.lmp_subver));
 				if (ver)
 					bt_free(ver);
 			}
 
-			if (hci_read_remote_features(dd, handle, features, 20000) == 0) {
-				char *tmp = lmp_featurestostr(features, "\t\t", 63);
+			if (!rinfo.feat_err) {
+				char *tmp;
+
+				memcpy(features, rinfo.feat.features, 8);
+				tmp = lmp_featurestostr(features, "\t\t", 63);
 				printf("LMP features:\t0x%2.2x 0x%2.2x 0x%2.2x 0x%2.2x"
 					" 0x%2.2x 0x%2.2x 0x%2.2x 0x%2.2x\n",
 					features[0], features[1],
@@ -904,8 +1026,8 @@ static void cmd_info(int dev_id, int argc, char **argv)
 	bdaddr_t bdaddr;
 	uint16_t handle;
 	uint8_t features[8], max_page = 0;
-	char name[249], *comp, *tmp;
-	struct hci_version version;
+	char *comp, *tmp;
+	struct remote_info info;
 	struct hci_dev_info di;
 	struct hci_conn_info_req *cr;
 	int i, opt, dd, cc = 0;
@@ -977,24 +1099,29 @@ static void cmd_info(int dev_id, int argc, char **argv)
 		free(comp);
 	}
 
-	if (hci_read_remote_name(dd, &bdaddr, sizeof(name), name, 25000) == 0)
-		printf("\tDevice Name: %s\n", name);
+	read_remote_info(dd, &bdaddr, 0x02, 0x0000, handle, 25000, &info);
+
+	if (!info.name_err) {
+		info.name.name[247] = '\0';
+		printf("\tDevice Name: %s\n", info.name.name);
+	}
 
-	if (hci_read_remote_version(dd, handle, &version, 20000) == 0) {
-		char *ver = lmp_vertostr(version.lmp_ver);
+	if (!info.ver_err) {
+		char *ver = lmp_vertostr(info.ver.lmp_ver);
 		printf("\tLMP Version: %s (0x%x) LMP Subversion: 0x%x\n"
 			"\tManufacturer: %s (%d)\n",
 			ver ? ver : "n/a",
-			version.lmp_ver,
-			version.lmp_subver,
-			bt_compidtostr(version.manufacturer),
-			version.manufacturer);
+			info.ver.lmp_ver,
+			btohs(info.ver.lmp_subver),
+			bt_compidtostr(btohs(info.ver.manufacturer)),
+			btohs(info.ver.manufacturer));
 		if (ver)
 			bt_free(ver);
 	}
 
 	memset(features, 0, sizeof(features));
-	hci_read_remote_features(dd, handle, features, 20000);
+	if (!info.feat_err)
+		memcpy(features, info.feat.features, 8);
 
 	if ((di.features[7] & LMP_EXT_FEAT) && (features[7] & LMP_EXT_FEAT))
 		hci_read_remote_ext_features(dd, handle, 0, &max_page,
@@ -2435,13 +2562,292 @@ failed:
 	snprintf(buf, buf_len, "(unknown)");
 }
 
-static int print_advertising_devices(int dd, uint8_t filter_type)
+/* LE scan summary mode.
+ *
+ * Reports are deduplicated by address in a hash table that aggregates
+ * RSSI and last seen time, and only a compact summary of the devices
+ * seen in each interval is printed. Devices not heard for
+ * LE_DEV_EXPIRE intervals are dropped, so rotating private addresses
+ * don't grow the table forever. */
+
+#define LE_DEV_HASH_SIZE	1024
+#define LE_DEV_EXPIRE		10
+#define LE_SCAN_BATCH		32
+
+struct le_dev {
+	struct le_dev *next;
+	bdaddr_t bdaddr;
+	uint8_t bdaddr_type;
+	int8_t rssi;
+	int8_t rssi_min;
+	int8_t rssi_max;
+	int rssi_sum;
+	unsigned int count;
+	unsigned int total;
+	uint64_t last_seen;
+	char name[30];
+};
+
+struct le_scan {
+	uint8_t filter_type;
+	int summary;		/* summary interval in ms, 0 for per report */
+	int json;
+	struct le_dev *hash[LE_DEV_HASH_SIZE];
+	unsigned int devices;
+	unsigned int new_devices;
+	unsigned long reports;
+	unsigned long total_reports;
+	uint64_t start;
+	uint64_t last_summary;
+};
+
+static uint64_t le_scan_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static unsigned int le_dev_hash(const bdaddr_t *bdaddr, uint8_t type)
+{
+	unsigned int h = type;
+	int i;
+
+	for (i = 0; i < 6; i++)
+		h = h * 31 + bdaddr->b[i];
+
+	return (h ^ (h >> 10)) & (LE_DEV_HASH_SIZE - 1);
+}
+
+static struct le_dev *le_dev_get(struct le_scan *s, le_advertising_info *info)
 {
-	unsigned char buf[HCI_MAX_EVENT_SIZE], *ptr;
+	unsigned int h = le_dev_hash(&info->bdaddr, info->bdaddr_type);
+	struct le_dev *dev;
+
+	for (dev = s->hash[h]; dev; dev = dev->next) {
+		if (dev->bdaddr_type == info->bdaddr_type &&
+				!bacmp(&dev->bdaddr, &info->bdaddr))
+			return dev;
+	}
+
+	dev = calloc(1, sizeof(*dev));
+	if (!dev)
+		return NULL;
+
+	bacpy(&dev->bdaddr, &info->bdaddr);
+	dev->bdaddr_type = info->bdaddr_type;
+	dev->next = s->hash[h];
+	s->hash[h] = dev;
+	s->devices++;
+	s->new_devices++;
+
+	return dev;
+}
+
+static void le_scan_free(struct le_scan *s)
+{
+	struct le_dev *dev, *next;
+	int i;
+
+	for (i = 0; i < LE_DEV_HASH_SIZE; i++) {
+		for (dev = s->hash[i]; dev; dev = next) {
+			next = dev->next;
+			free(dev);
+		}
+		s->hash[i] = NULL;
+	}
+}
+
+static void print_json_str(const char *str)
+{
+	putchar('"');
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			printf("\\%c", *str);
+		else if ((unsigned char) *str < 0x20)
+			printf("\\u%04x", *str);
+		else
+			putchar(*str);
+	}
+	putchar('"');
+}
+
+static void le_scan_summary(struct le_scan *s, uint64_t now)
+{
+	uint64_t elapsed = now - s->last_summary;
+	unsigned long rate;
+	struct le_dev *dev, **pdev;
+	char addr[18];
+	int i;
+
+	if (!elapsed)
+		elapsed = 1;
+	rate = s->reports * 1000 / elapsed;
+
+	if (s->json)
+		printf("{\"time\":%llu,\"reports\":%lu,\"rate\":%lu,"
+			"\"devices\":%u,\"new\":%u}\n",
+			(unsigned long long) (now - s->start), s->reports,
+			rate, s->devices, s->new_devices);
+	else
+		printf("--- %llu.%03llus: %lu reports (%lu/s), %u devices "
+			"(%u new)\n",
+			(unsigned long long) (now - s->start) / 1000,
+			(unsigned long long) (now - s->start) % 1000,
+			s->reports, rate, s->devices, s->new_devices);
+
+	for (i = 0; i < LE_DEV_HASH_SIZE; i++) {
+		pdev = &s->hash[i];
+		while ((dev = *pdev)) {
+			if (!dev->count) {
+				if (now - dev->last_seen >= (uint64_t) s->summary *
+								LE_DEV_EXPIRE) {
+					*pdev = dev->next;
+					free(dev);
+					s->devices--;
+				} else
+					pdev = &dev->next;
+				continue;
+			}
+
+			ba2str(&dev->bdaddr, addr);
+
+			if (s->json) {
+				printf("{\"addr\":\"%s\",\"type\":%u,"
+					"\"rssi\":%d,\"rssi_min\":%d,"
+					"\"rssi_max\":%d,\"rssi_avg\":%d,"
+					"\"count\":%u,\"total\":%u,"
+					"\"age\":%llu,\"name\":",
+					addr, dev->bdaddr_type, dev->rssi,
+					dev->rssi_min, dev->rssi_max,
+					dev->rssi_sum / (int) dev->count,
+					dev->count, dev->total,
+					(unsigned long long)
+						(now - dev->last_seen));
+				print_json_str(dev->name);
+				printf("}\n");
+			} else
+				printf("%s %u %4d dBm (%d/%d/%d) %5u %s\n",
+					addr, dev->bdaddr_type, dev->rssi,
+					dev->rssi_min,
+					dev->rssi_sum / (int) dev->count,
+					dev->rssi_max, dev->count, dev->name);
+
+			dev->count = 0;
+			pdev = &dev->next;
+		}
+	}
+
+	fflush(stdout);
+
+	s->total_reports += s->reports;
+	s->reports = 0;
+	s->new_devices = 0;
+	s->last_summary = now;
+}
+
+static void le_scan_report(struct le_scan *s, le_advertising_info *info,
+						int8_t rssi, uint64_t now)
+{
+	struct le_dev *dev;
+	char addr[18];
+
+	if (!check_report_filter(s->filter_type, info))
+		return;
+
+	s->reports++;
+
+	if (!s->summary) {
+		char name[30];
+
+		memset(name, 0, sizeof(name));
+
+		ba2str(&info->bdaddr, addr);
+		eir_parse_name(info->data, info->length,
+						name, sizeof(name) - 1);
+
+		printf("%s %s\n", addr, name);
+		return;
+	}
+
+	dev = le_dev_get(s, info);
+	if (!dev)
+		return;
+
+	if (!dev->count) {
+		dev->rssi_min = rssi;
+		dev->rssi_max = rssi;
+		dev->rssi_sum = 0;
+	}
+
+	dev->rssi = rssi;
+	dev->rssi_min = MIN(dev->rssi_min, rssi);
+	dev->rssi_max = MAX(dev->rssi_max, rssi);
+	dev->rssi_sum += rssi;
+	dev->count++;
+	dev->total++;
+	dev->last_seen = now;
+
+	if (!dev->name[0] || !strcmp(dev->name, "(unknown)"))
+		eir_parse_name(info->data, info->length,
+					dev->name, sizeof(dev->name) - 1);
+}
+
+/* Handle one HCI event packet, including the packet type byte */
+static void le_scan_event(struct le_scan *s, uint8_t *buf, int len,
+								uint64_t now)
+{
+	hci_event_hdr *hdr = (void *) (buf + 1);
+	evt_le_meta_event *meta;
+	uint8_t *ptr;
+	int num;
+
+	if (len < 1 + HCI_EVENT_HDR_SIZE + 2)
+		return;
+
+	if (hdr->evt != EVT_LE_META_EVENT)
+		return;
+
+	meta = (void *) (buf + 1 + HCI_EVENT_HDR_SIZE);
+	len -= 1 + HCI_EVENT_HDR_SIZE + 2;
+
+	if (meta->subevent != EVT_LE_ADVERTISING_REPORT)
+		return;
+
+	num = meta->data[0];
+	ptr = meta->data + 1;
+
+	while (num--) {
+		le_advertising_info *info = (void *) ptr;
+		int size;
+
+		if (len < LE_ADVERTISING_INFO_SIZE + 1)
+			break;
+
+		size = LE_ADVERTISING_INFO_SIZE + info->length + 1;
+		if (size > len)
+			break;
+
+		le_scan_report(s, info, (int8_t) ptr[size - 1], now);
+
+		ptr += size;
+		len -= size;
+	}
+}
+
+static int print_advertising_devices(int dd, struct le_scan *s)
+{
+	unsigned char buf[LE_SCAN_BATCH][HCI_MAX_EVENT_SIZE];
+	struct mmsghdr msgs[LE_SCAN_BATCH];
+	struct iovec iov[LE_SCAN_BATCH];
 	struct hci_filter nf, of;
 	struct sigaction sa;
+	struct pollfd p;
 	socklen_t olen;
-	int len;
+	uint64_t now;
+	int i, n, to, err = 0;
 
 	olen = sizeof(of);
 	if (getsockopt(dd, SOL_HCI, HCI_FILTER, &of, &olen) < 0) {
@@ -2463,50 +2869,153 @@ static int print_advertising_devices(int dd, uint8_t filter_type)
 	sa.sa_handler = sigint_handler;
 	sigaction(SIGINT, &sa, NULL);
 
-	while (1) {
-		evt_le_meta_event *meta;
-		le_advertising_info *info;
-		char addr[18];
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < LE_SCAN_BATCH; i++) {
+		iov[i].iov_base = buf[i];
+		iov[i].iov_len = sizeof(buf[i]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
 
-		while ((len = read(dd, buf, sizeof(buf))) < 0) {
-			if (errno == EINTR && signal_received == SIGINT) {
-				len = 0;
-				goto done;
-			}
+	p.fd = dd;
+	p.events = POLLIN;
+
+	s->start = s->last_summary = le_scan_now();
 
+	while (!signal_received) {
+		to = -1;
+		if (s->summary) {
+			now = le_scan_now();
+			if (now >= s->last_summary + s->summary)
+				le_scan_summary(s, now);
+			to = s->last_summary + s->summary - now;
+		}
+
+		n = poll(&p, 1, to);
+		if (n < 0) {
 			if (errno == EAGAIN || errno == EINTR)
 				continue;
-			goto done;
+			err = -1;
+			break;
 		}
 
-		ptr = buf + (1 + HCI_EVENT_HDR_SIZE);
-		len -= (1 + HCI_EVENT_HDR_SIZE);
+		if (!n)
+			continue;
+
+		/* Drain everything queued on the socket in batches */
+		do {
+			n = recvmmsg(dd, msgs, LE_SCAN_BATCH, MSG_DONTWAIT,
+									NULL);
+			if (n < 0) {
+				if (errno == EAGAIN || errno == EINTR)
+					break;
+				err = -1;
+				goto done;
+			}
 
-		meta = (void *) ptr;
+			now = s->summary ? le_scan_now() : 0;
+			for (i = 0; i < n; i++)
+				le_scan_event(s, buf[i], msgs[i].msg_len, now);
+		} while (n == LE_SCAN_BATCH);
+	}
 
-		if (meta->subevent != 0x02)
-			goto done;
+done:
+	if (s->summary)
+		le_scan_summary(s, le_scan_now());
 
-		/* Ignoring multiple reports */
-		info = (le_advertising_info *) (meta->data + 1);
-		if (check_report_filter(filter_type, info)) {
-			char name[30];
+	setsockopt(dd, SOL_HCI, HCI_FILTER, &of, sizeof(of));
 
-			memset(name, 0, sizeof(name));
+	return err;
+}
+
+/* Feed LE advertising reports from a btsnoop file through the scan
+ * engine, using the capture timestamps for the summary intervals. */
+static int replay_advertising_devices(const char *path, struct le_scan *s)
+{
+	static const uint8_t id[8] = { 'b', 't', 's', 'n', 'o', 'o', 'p', 0 };
+	uint8_t hdr[16], pkt[24], buf[1 + HCI_MAX_EVENT_SIZE];
+	unsigned long events = 0;
+	uint32_t type, len, flags;
+	uint64_t ts, start, end;
+	int fd, off;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (read(fd, hdr, sizeof(hdr)) != sizeof(hdr) ||
+					memcmp(hdr, id, sizeof(id))) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* HCI (1001) and monitor (2001) captures have no packet type byte,
+	 * HCI UART (1002) ones do. The others carry no HCI events. */
+	type = hdr[12] << 24 | hdr[13] << 16 | hdr[14] << 8 | hdr[15];
+	if (type != 1001 && type != 1002 && type != 2001) {
+		fprintf(stderr, "%s: unsupported btsnoop datalink type %u\n",
+								path, type);
+		close(fd);
+		errno = EPROTONOSUPPORT;
+		return -1;
+	}
+
+	s->start = s->last_summary = 0;
+	start = le_scan_now();
 
-			ba2str(&info->bdaddr, addr);
-			eir_parse_name(info->data, info->length,
-							name, sizeof(name) - 1);
+	while (read(fd, pkt, sizeof(pkt)) == sizeof(pkt)) {
+		len = pkt[4] << 24 | pkt[5] << 16 | pkt[6] << 8 | pkt[7];
+		flags = pkt[8] << 24 | pkt[9] << 16 | pkt[10] << 8 | pkt[11];
+		ts = (uint64_t) pkt[16] << 56 | (uint64_t) pkt[17] << 48 |
+			(uint64_t) pkt[18] << 40 | (uint64_t) pkt[19] << 32 |
+			(uint64_t) pkt[20] << 24 | (uint64_t) pkt[21] << 16 |
+			(uint64_t) pkt[22] << 8 | (uint64_t) pkt[23];
+		ts /= 1000;
 
-			printf("%s %s\n", addr, name);
+		buf[0] = HCI_EVENT_PKT;
+		off = type == 1002 ? 0 : 1;
+
+		if (len + off > sizeof(buf)) {
+			lseek(fd, len, SEEK_CUR);
+			continue;
 		}
+
+		if (read(fd, buf + off, len) != (ssize_t) len)
+			break;
+
+		/* HCI flags: bit 1 command/event, bit 0 received;
+		 * monitor flags: opcode 3 is event */
+		if (type == 1001 && (flags & 0x03) != 0x03)
+			continue;
+		if (type == 2001 && (flags & 0xffff) != 0x03)
+			continue;
+		if (type == 1002 && buf[0] != HCI_EVENT_PKT)
+			continue;
+
+		if (!s->start)
+			s->start = s->last_summary = ts;
+
+		if (s->summary && ts >= s->last_summary + s->summary)
+			le_scan_summary(s, ts);
+
+		le_scan_event(s, buf, len + off, ts);
+		events++;
 	}
 
-done:
-	setsockopt(dd, SOL_HCI, HCI_FILTER, &of, sizeof(of));
+	end = le_scan_now();
+	close(fd);
 
-	if (len < 0)
-		return -1;
+	if (s->summary)
+		le_scan_summary(s, s->last_summary + s->summary);
+
+	s->total_reports += s->reports;
+
+	fprintf(stderr, "Replayed %lu events, %lu reports in %llu ms "
+			"(%llu reports/s)\n", events, s->total_reports,
+			(unsigned long long) (end - start),
+			(unsigned long long) (s->total_reports * 1000 /
+						(end - start ? end - start : 1)));
 
 	return 0;
 }
@@ -2518,6 +3027,9 @@ static struct option lescan_options[] = {
 	{ "whitelist",	0, 0, 'w' },
 	{ "discovery",	1, 0, 'd' },
 	{ "duplicates",	0, 0, 'D' },
+	{ "summary",	2, 0, 's' },
+	{ "json",	0, 0, 'j' },
+	{ "replay",	1, 0, 'r' },
 	{ 0, 0, 0, 0 }
 };
 
@@ -2528,7 +3040,10 @@ static const char *lescan_help =
 	"\tlescan [--whitelist] scan for address in the whitelist only\n"
 	"\tlescan [--discovery=g|l] enable general or limited discovery"
 		"procedure\n"
-	"\tlescan [--duplicates] don't filter duplicates\n";
+	"\tlescan [--duplicates] don't filter duplicates\n"
+	"\tlescan [--summary[=sec]] print deduplicated devices every sec\n"
+	"\tlescan [--json] print the summary as JSON lines\n"
+	"\tlescan [--replay=file] read reports from a btsnoop file\n";
 
 static void cmd_lescan(int dev_id, int argc, char **argv)
 {
@@ -2540,6 +3055,8 @@ static void cmd_lescan(int dev_id, int argc, char **argv)
 	uint16_t interval = htobs(0x0010);
 	uint16_t window = htobs(0x0010);
 	uint8_t filter_dup = 1;
+	const char *replay = NULL;
+	static struct le_scan scan;
 
 	for_each_opt(opt, lescan_options, NULL) {
 		switch (opt) {
@@ -2565,6 +3082,17 @@ static void cmd_lescan(int dev_id, int argc, char **argv)
 		case 'D':
 			filter_dup = 0x00;
 			break;
+		case 's':
+			scan.summary = optarg ? atoi(optarg) * 1000 : 1000;
+			if (scan.summary <= 0)
+				scan.summary = 1000;
+			break;
+		case 'j':
+			scan.json = 1;
+			break;
+		case 'r':
+			replay = optarg;
+			break;
 		default:
 			printf("%s", lescan_help);
 			return;
@@ -2572,6 +3100,19 @@ static void cmd_lescan(int dev_id, int argc, char **argv)
 	}
 	helper_arg(0, 1, &argc, &argv, lescan_help);
 
+	scan.filter_type = filter_type;
+	if (scan.json && !scan.summary)
+		scan.summary = 1000;
+
+	if (replay) {
+		if (replay_advertising_devices(replay, &scan) < 0) {
+			perror("Could not replay advertising events");
+			exit(1);
+		}
+		le_scan_free(&scan);
+		return;
+	}
+
 	if (dev_id < 0)
 		dev_id = hci_get_route(NULL);
 
@@ -2596,7 +3137,8 @@ static void cmd_lescan(int dev_id, int argc, char **argv)
 
 	printf("LE Scan ...\n");
 
-	err = print_advertising_devices(dd, filter_type);
+	err = print_advertising_devices(dd, &scan);
+	le_scan_free(&scan);
 	if (err < 0) {
 		perror("Could not receive advertising events");
 		exit(1);
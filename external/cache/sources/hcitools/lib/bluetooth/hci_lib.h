@@ -53,6 +53,23 @@ int hci_close_dev(int dd);
 int hci_send_cmd(int dd, uint16_t ogf, uint16_t ocf, uint8_t plen, void *param);
 int hci_send_req(int dd, struct hci_request *req, int timeout);
 
+/* Asynchronous command queue. The request and its parameter buffers must
+ * stay valid until the callback is called. err is 0 on success or an
+ * errno value (EIO, ETIMEDOUT, ECANCELED, ...). */
+struct hci_cmd_queue;
+typedef void (*hci_cmd_func_t)(int err, struct hci_request *req,
+							void *user_data);
+
+struct hci_cmd_queue *hci_cmd_queue_new(int dd);
+void hci_cmd_queue_free(struct hci_cmd_queue *q);
+int hci_cmd_queue_send(struct hci_cmd_queue *q, struct hci_request *req,
+			int timeout, hci_cmd_func_t func, void *user_data);
+int hci_cmd_queue_fd(struct hci_cmd_queue *q);
+int hci_cmd_queue_timeout(struct hci_cmd_queue *q);
+int hci_cmd_queue_pending(struct hci_cmd_queue *q);
+int hci_cmd_queue_process(struct hci_cmd_queue *q);
+int hci_cmd_queue_flush(struct hci_cmd_queue *q);
+
 int hci_create_connection(int dd, const bdaddr_t *bdaddr, uint16_t ptype, uint16_t clkoffset, uint8_t rswitch, uint16_t *handle, int to);
 int hci_disconnect(int dd, uint16_t handle, uint8_t reason, int to);
 
@@ -34,6 +34,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <time.h>
+#include <pthread.h>
 #include <sys/param.h>
 #include <sys/uio.h>
 #include <sys/poll.h>
@@ -1095,7 +1097,501 @@ int hci_send_cmd(int dd, uint16_t ogf, uint16_t ocf, uint8_t plen, void *param)
 	return 0;
 }
 
-int hci_send_req(int dd, struct hci_request *r, int to)
+/* Asynchronous command queue.
+ *
+ * A queue installs one event filter on the device descriptor for its
+ * whole lifetime and keeps as many commands in flight as the controller
+ * grants through Num_HCI_Command_Packets. Completions are matched by
+ * opcode (or by the expected event) and reported through callbacks,
+ * either from hci_cmd_queue_process() driven by the caller's own poll
+ * loop on hci_cmd_queue_fd() or from hci_cmd_queue_flush().
+ *
+ * The list of open queues is shared by all threads and locked; a queue
+ * itself must only be used by the thread that owns its descriptor. */
+
+enum {
+	HCI_CMD_QUEUED,
+	HCI_CMD_SENT,
+	HCI_CMD_WAIT_EVENT,
+};
+
+struct hci_cmd_entry {
+	struct hci_cmd_entry *next;
+	struct hci_request *r;
+	uint16_t opcode;
+	int state;
+	long long deadline;
+	hci_cmd_func_t func;
+	void *user_data;
+};
+
+struct hci_cmd_queue {
+	struct hci_cmd_queue *next;
+	int dd;
+	int credits;
+	struct hci_filter of;
+	struct hci_filter nf;
+	struct hci_cmd_entry *head;
+	struct hci_cmd_entry *tail;
+};
+
+static struct hci_cmd_queue *cmd_queues;
+static pthread_mutex_t cmd_queues_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static struct hci_cmd_queue *find_queue(int dd)
+{
+	struct hci_cmd_queue *q;
+
+	pthread_mutex_lock(&cmd_queues_lock);
+
+	for (q = cmd_queues; q; q = q->next)
+		if (q->dd == dd)
+			break;
+
+	pthread_mutex_unlock(&cmd_queues_lock);
+
+	return q;
+}
+
+struct hci_cmd_queue *hci_cmd_queue_new(int dd)
+{
+	struct hci_cmd_queue *q;
+	socklen_t olen;
+
+	q = calloc(1, sizeof(*q));
+	if (!q)
+		return NULL;
+
+	olen = sizeof(q->of);
+	if (getsockopt(dd, SOL_HCI, HCI_FILTER, &q->of, &olen) < 0)
+		goto failed;
+
+	hci_filter_clear(&q->nf);
+	hci_filter_set_ptype(HCI_EVENT_PKT,  &q->nf);
+	hci_filter_set_event(EVT_CMD_STATUS, &q->nf);
+	hci_filter_set_event(EVT_CMD_COMPLETE, &q->nf);
+	hci_filter_set_event(EVT_LE_META_EVENT, &q->nf);
+	if (setsockopt(dd, SOL_HCI, HCI_FILTER, &q->nf, sizeof(q->nf)) < 0)
+		goto failed;
+
+	q->dd = dd;
+	q->credits = 1;
+
+	pthread_mutex_lock(&cmd_queues_lock);
+	q->next = cmd_queues;
+	cmd_queues = q;
+	pthread_mutex_unlock(&cmd_queues_lock);
+
+	return q;
+
+failed:
+	free(q);
+	return NULL;
+}
+
+static void complete_entry(struct hci_cmd_queue *q, struct hci_cmd_entry *e,
+								int err)
+{
+	struct hci_cmd_entry **pe;
+
+	for (pe = &q->head; *pe; pe = &(*pe)->next) {
+		if (*pe != e)
+			continue;
+
+		*pe = e->next;
+		if (q->tail == e) {
+			struct hci_cmd_entry *t;
+
+			for (t = q->head; t && t->next; t = t->next);
+			q->tail = t;
+		}
+		break;
+	}
+
+	if (e->func)
+		e->func(err, e->r, e->user_data);
+
+	free(e);
+}
+
+/* Drop the entry of user_data without calling back, for a caller that
+ * gives up on its request before it completed. */
+static void cancel_entry(struct hci_cmd_queue *q, void *user_data)
+{
+	struct hci_cmd_entry *e;
+
+	for (e = q->head; e; e = e->next) {
+		if (e->user_data == user_data) {
+			e->func = NULL;
+			complete_entry(q, e, ECANCELED);
+			return;
+		}
+	}
+}
+
+/* Commands still queued or in flight are completed with ECANCELED and
+ * the filter active before hci_cmd_queue_new() is restored. */
+void hci_cmd_queue_free(struct hci_cmd_queue *q)
+{
+	struct hci_cmd_queue **pq;
+
+	if (!q)
+		return;
+
+	while (q->head)
+		complete_entry(q, q->head, ECANCELED);
+
+	pthread_mutex_lock(&cmd_queues_lock);
+
+	for (pq = &cmd_queues; *pq; pq = &(*pq)->next) {
+		if (*pq == q) {
+			*pq = q->next;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&cmd_queues_lock);
+
+	setsockopt(q->dd, SOL_HCI, HCI_FILTER, &q->of, sizeof(q->of));
+	free(q);
+}
+
+int hci_cmd_queue_fd(struct hci_cmd_queue *q)
+{
+	return q->dd;
+}
+
+int hci_cmd_queue_pending(struct hci_cmd_queue *q)
+{
+	struct hci_cmd_entry *e;
+	int n = 0;
+
+	for (e = q->head; e; e = e->next)
+		n++;
+
+	return n;
+}
+
+/* Milliseconds until the next command times out, -1 if none can */
+int hci_cmd_queue_timeout(struct hci_cmd_queue *q)
+{
+	struct hci_cmd_entry *e;
+	long long now, next = -1;
+
+	for (e = q->head; e; e = e->next) {
+		if (e->deadline && (next < 0 || e->deadline < next))
+			next = e->deadline;
+	}
+
+	if (next < 0)
+		return -1;
+
+	now = now_ms();
+
+	return next > now ? next - now : 0;
+}
+
+static int flush_queued(struct hci_cmd_queue *q)
+{
+	struct hci_cmd_entry *e, *next;
+
+	for (e = q->head; e && q->credits > 0; e = next) {
+		struct hci_request *r = e->r;
+
+		next = e->next;
+
+		if (e->state != HCI_CMD_QUEUED)
+			continue;
+
+		if (hci_send_cmd(q->dd, r->ogf, r->ocf, r->clen,
+							r->cparam) < 0) {
+			complete_entry(q, e, errno);
+			next = q->head;
+			continue;
+		}
+
+		e->state = HCI_CMD_SENT;
+		q->credits--;
+	}
+
+	return 0;
+}
+
+int hci_cmd_queue_send(struct hci_cmd_queue *q, struct hci_request *r, int to,
+				hci_cmd_func_t func, void *user_data)
+{
+	struct hci_cmd_entry *e;
+
+	if (r->event && !hci_filter_test_event(r->event, &q->nf)) {
+		hci_filter_set_event(r->event, &q->nf);
+		if (setsockopt(q->dd, SOL_HCI, HCI_FILTER, &q->nf,
+							sizeof(q->nf)) < 0)
+			return -1;
+	}
+
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return -1;
+
+	e->r = r;
+	e->opcode = htobs(cmd_opcode_pack(r->ogf, r->ocf));
+	e->state = HCI_CMD_QUEUED;
+	e->deadline = to > 0 ? now_ms() + to : 0;
+	e->func = func;
+	e->user_data = user_data;
+
+	if (q->tail)
+		q->tail->next = e;
+	else
+		q->head = e;
+	q->tail = e;
+
+	return flush_queued(q);
+}
+
+/* LE subevent codes overlap the HCI event codes. The event of an LE
+ * controller command other than Command Status/Complete is an LE Meta
+ * subevent, so such requests are matched on their own, keyed on
+ * (EVT_LE_META_EVENT, subevent). */
+static int le_meta_req(struct hci_request *r)
+{
+	return r->ogf == OGF_LE_CTL && r->event != EVT_CMD_STATUS &&
+					r->event != EVT_CMD_COMPLETE;
+}
+
+static struct hci_cmd_entry *find_entry(struct hci_cmd_queue *q, int evt,
+						uint16_t opcode, void *ptr)
+{
+	struct hci_cmd_entry *e;
+
+	for (e = q->head; e; e = e->next) {
+		struct hci_request *r = e->r;
+
+		if (e->state == HCI_CMD_QUEUED)
+			continue;
+
+		if (evt != EVT_CMD_STATUS && evt != EVT_CMD_COMPLETE &&
+							le_meta_req(r))
+			continue;
+
+		switch (evt) {
+		case EVT_CMD_STATUS:
+		case EVT_CMD_COMPLETE:
+			if (e->state == HCI_CMD_SENT && e->opcode == opcode)
+				return e;
+			break;
+
+		case EVT_REMOTE_NAME_REQ_COMPLETE:
+			if (r->event == evt &&
+				!bacmp(&((evt_remote_name_req_complete *)
+					ptr)->bdaddr,
+				&((remote_name_req_cp *) r->cparam)->bdaddr))
+				return e;
+			break;
+
+		default:
+			if (r->event == EVT_CMD_STATUS ||
+					r->event == EVT_CMD_COMPLETE)
+				break;
+			if (r->event == evt)
+				return e;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static struct hci_cmd_entry *find_le_entry(struct hci_cmd_queue *q,
+							uint8_t subevent)
+{
+	struct hci_cmd_entry *e;
+
+	for (e = q->head; e; e = e->next) {
+		if (e->state == HCI_CMD_QUEUED)
+			continue;
+
+		if (le_meta_req(e->r) && e->r->event == subevent)
+			return e;
+	}
+
+	return NULL;
+}
+
+static void copy_rparam(struct hci_request *r, void *ptr, int len)
+{
+	r->rlen = MIN(len, r->rlen);
+	memcpy(r->rparam, ptr, r->rlen);
+}
+
+static void process_event(struct hci_cmd_queue *q, unsigned char *buf,
+								int len)
+{
+	hci_event_hdr *hdr = (void *) (buf + 1);
+	unsigned char *ptr = buf + (1 + HCI_EVENT_HDR_SIZE);
+	struct hci_cmd_entry *e;
+	evt_cmd_complete *cc;
+	evt_cmd_status *cs;
+	evt_le_meta_event *me;
+
+	len -= (1 + HCI_EVENT_HDR_SIZE);
+	if (len < 0)
+		return;
+
+	switch (hdr->evt) {
+	case EVT_CMD_STATUS:
+		cs = (void *) ptr;
+		q->credits = cs->ncmd;
+
+		e = find_entry(q, hdr->evt, cs->opcode, ptr);
+		if (!e)
+			break;
+
+		if (e->r->event != EVT_CMD_STATUS) {
+			if (cs->status)
+				complete_entry(q, e, EIO);
+			else
+				e->state = HCI_CMD_WAIT_EVENT;
+			break;
+		}
+
+		copy_rparam(e->r, ptr, len);
+		complete_entry(q, e, 0);
+		break;
+
+	case EVT_CMD_COMPLETE:
+		cc = (void *) ptr;
+		q->credits = cc->ncmd;
+
+		e = find_entry(q, hdr->evt, cc->opcode, ptr);
+		if (!e)
+			break;
+
+		copy_rparam(e->r, ptr + EVT_CMD_COMPLETE_SIZE,
+						len - EVT_CMD_COMPLETE_SIZE);
+		complete_entry(q, e, 0);
+		break;
+
+	case EVT_LE_META_EVENT:
+		me = (void *) ptr;
+		if (len < 1)
+			break;
+
+		e = find_le_entry(q, me->subevent);
+		if (!e)
+			break;
+
+		copy_rparam(e->r, me->data, len - 1);
+		complete_entry(q, e, 0);
+		break;
+
+	default:
+		e = find_entry(q, hdr->evt, 0, ptr);
+		if (!e)
+			break;
+
+		copy_rparam(e->r, ptr, len);
+		complete_entry(q, e, 0);
+		break;
+	}
+}
+
+static void expire_entries(struct hci_cmd_queue *q)
+{
+	struct hci_cmd_entry *e, *next;
+	long long now = now_ms();
+
+	for (e = q->head; e; e = next) {
+		next = e->next;
+
+		if (!e->deadline || e->deadline > now)
+			continue;
+
+		/* Don't stall the queue on a credit that never comes back */
+		if (e->state == HCI_CMD_SENT && q->credits < 1)
+			q->credits = 1;
+
+		complete_entry(q, e, ETIMEDOUT);
+		next = q->head;
+	}
+}
+
+/* Read and dispatch all events available without blocking.
+ * Returns the number of events processed or -1 on error. */
+int hci_cmd_queue_process(struct hci_cmd_queue *q)
+{
+	unsigned char buf[HCI_MAX_EVENT_SIZE];
+	int len, n = 0;
+
+	while ((len = recv(q->dd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+		process_event(q, buf, len);
+		n++;
+	}
+
+	if (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+							errno != EINTR)
+		return -1;
+
+	expire_entries(q);
+	flush_queued(q);
+
+	return n;
+}
+
+/* Wait until *done is set, or until the queue is empty if done is NULL */
+static int queue_wait(struct hci_cmd_queue *q, int *done)
+{
+	struct pollfd p;
+	int n;
+
+	p.fd = q->dd; p.events = POLLIN;
+
+	while (done ? !*done : q->head != NULL) {
+		n = poll(&p, 1, hci_cmd_queue_timeout(q));
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		if (hci_cmd_queue_process(q) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/* Block until every queued command has completed */
+int hci_cmd_queue_flush(struct hci_cmd_queue *q)
+{
+	return queue_wait(q, NULL);
+}
+
+struct send_req_data {
+	int done;
+	int err;
+};
+
+static void send_req_done(int err, struct hci_request *r, void *user_data)
+{
+	struct send_req_data *d = user_data;
+
+	d->err = err;
+	d->done = 1;
+}
+
+/* One command with no queue open on dd: swap in a filter for this
+ * request and read events synchronously until the matching one. */
+static int send_req_sync(int dd, struct hci_request *r, int to)
 {
 	unsigned char buf[HCI_MAX_EVENT_SIZE], *ptr;
 	uint16_t opcode = htobs(cmd_opcode_pack(r->ogf, r->ocf));
@@ -1241,6 +1737,30 @@ done:
 	return 0;
 }
 
+int hci_send_req(int dd, struct hci_request *r, int to)
+{
+	struct hci_cmd_queue *q;
+	struct send_req_data d = { 0, 0 };
+
+	q = find_queue(dd);
+	if (!q)
+		return send_req_sync(dd, r, to);
+
+	if (hci_cmd_queue_send(q, r, to, send_req_done, &d) < 0 ||
+					queue_wait(q, &d.done) < 0) {
+		d.err = errno;
+		/* r and d live on the stack, don't leave them queued */
+		cancel_entry(q, &d);
+	}
+
+	if (d.err) {
+		errno = d.err;
+		return -1;
+	}
+
+	return 0;
+}
+
 int hci_create_connection(int dd, const bdaddr_t *bdaddr, uint16_t ptype,
 				uint16_t clkoffset, uint8_t rswitch,
 				uint16_t *handle, int to)
@@ -29,10 +29,17 @@
 #include <stdio.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 
 #include <bluetooth/bluetooth.h>
@@ -66,57 +73,355 @@ static uint32_t btsnoop_type = 0;
 static int btsnoop_fd = -1;
 static uint16_t btsnoop_index = 0xffff;
 
-void btsnoop_create(const char *path, uint32_t type)
+static char *btsnoop_path = NULL;
+static unsigned int btsnoop_file_num = 0;
+static uint64_t btsnoop_file_size = 0;
+static time_t btsnoop_file_start = 0;
+
+static uint64_t btsnoop_rotate_size = 0;
+static unsigned int btsnoop_rotate_secs = 0;
+
+static uint32_t btsnoop_drops = 0;
+
+/*
+ * Buffered writer: packets are appended to the front buffer and full
+ * buffers are handed over to a flusher thread, so slow storage never
+ * blocks the monitor main loop.  When the flusher is still busy with
+ * the previous buffer, packets are dropped and accounted for in the
+ * drops field of the following records.
+ */
+static size_t btsnoop_buf_size = 0;
+static uint8_t *btsnoop_buf[2];
+static size_t btsnoop_buf_len = 0;
+static uint32_t btsnoop_buf_pkts = 0;
+
+static size_t btsnoop_flush_len = 0;
+static uint32_t btsnoop_flush_pkts = 0;
+static bool btsnoop_flush_pending = false;
+static bool btsnoop_flush_quit = false;
+
+static pthread_t btsnoop_flusher;
+static pthread_mutex_t btsnoop_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t btsnoop_cond = PTHREAD_COND_INITIALIZER;
+
+#define BTSNOOP_BUF_MIN_SIZE	(BTSNOOP_PKT_SIZE + 65535)
+
+static void add_drops(uint32_t count)
+{
+	__atomic_add_fetch(&btsnoop_drops, count, __ATOMIC_RELAXED);
+}
+
+static int create_file(const char *path)
 {
 	struct btsnoop_hdr hdr;
 	ssize_t written;
+	int fd;
 
-	if (btsnoop_fd >= 0)
-		return;
-
-	btsnoop_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
 				S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-	if (btsnoop_fd < 0)
-		return;
-
-	btsnoop_type = type;
+	if (fd < 0)
+		return -1;
 
 	memcpy(hdr.id, btsnoop_id, sizeof(btsnoop_id));
 	hdr.version = htonl(btsnoop_version);
 	hdr.type = htonl(btsnoop_type);
 
-	written = write(btsnoop_fd, &hdr, BTSNOOP_HDR_SIZE);
+	written = write(fd, &hdr, BTSNOOP_HDR_SIZE);
 	if (written < 0) {
-		close(btsnoop_fd);
-		btsnoop_fd = -1;
+		close(fd);
+		return -1;
+	}
+
+	btsnoop_file_size = BTSNOOP_HDR_SIZE;
+	btsnoop_file_start = time(NULL);
+
+	return fd;
+}
+
+static void rotate_file(size_t len)
+{
+	char path[PATH_MAX];
+	bool rotate = false;
+	int fd;
+
+	if (!btsnoop_path)
 		return;
+
+	if (btsnoop_rotate_size && btsnoop_file_size > BTSNOOP_HDR_SIZE &&
+				btsnoop_file_size + len > btsnoop_rotate_size)
+		rotate = true;
+
+	if (btsnoop_rotate_secs &&
+			time(NULL) - btsnoop_file_start >= btsnoop_rotate_secs)
+		rotate = true;
+
+	if (!rotate)
+		return;
+
+	snprintf(path, sizeof(path), "%s.%u", btsnoop_path,
+							++btsnoop_file_num);
+
+	/* On failure keep appending to the current file */
+	fd = create_file(path);
+	if (fd < 0)
+		return;
+
+	close(btsnoop_fd);
+	btsnoop_fd = fd;
+}
+
+/*
+ * Write all of iov, resuming after short writes.  Returns the number of
+ * bytes written, which is less than len only if writev() failed.
+ */
+static size_t write_iov(struct iovec *iov, int iovcnt, size_t len)
+{
+	size_t done = 0;
+	ssize_t written;
+
+	rotate_file(len);
+
+	while (done < len) {
+		written = writev(btsnoop_fd, iov, iovcnt);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			break;
+
+		done += written;
+
+		while (iovcnt > 0 && (size_t) written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+
+		if (iovcnt > 0) {
+			iov->iov_base = (uint8_t *) iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+
+	btsnoop_file_size += done;
+
+	return done;
+}
+
+/* Cut a partly written record off the end of the file */
+static void truncate_record(size_t partial)
+{
+	off_t size = btsnoop_file_size - partial;
+
+	if (!partial)
+		return;
+
+	if (ftruncate(btsnoop_fd, size) < 0 ||
+				lseek(btsnoop_fd, size, SEEK_SET) < 0)
+		return;
+
+	btsnoop_file_size = size;
+}
+
+/* Write a buffer of whole records, returns the number of records lost */
+static uint32_t write_records(uint8_t *buf, size_t len, uint32_t pkts)
+{
+	struct iovec iov;
+	size_t written, pos = 0;
+	uint32_t count = 0;
+
+	iov.iov_base = buf;
+	iov.iov_len = len;
+
+	written = write_iov(&iov, 1, len);
+	if (written == len)
+		return 0;
+
+	while (pos + BTSNOOP_PKT_SIZE <= written) {
+		const struct btsnoop_pkt *pkt = (void *) (buf + pos);
+		size_t rec_len = BTSNOOP_PKT_SIZE + ntohl(pkt->len);
+
+		if (pos + rec_len > written)
+			break;
+
+		pos += rec_len;
+		count++;
 	}
+
+	truncate_record(written - pos);
+
+	return pkts - count;
+}
+
+static void *flusher_thread(void *user_data)
+{
+	pthread_mutex_lock(&btsnoop_lock);
+
+	while (1) {
+		while (!btsnoop_flush_pending && !btsnoop_flush_quit)
+			pthread_cond_wait(&btsnoop_cond, &btsnoop_lock);
+
+		if (!btsnoop_flush_pending)
+			break;
+
+		pthread_mutex_unlock(&btsnoop_lock);
+
+		add_drops(write_records(btsnoop_buf[1], btsnoop_flush_len,
+							btsnoop_flush_pkts));
+
+		pthread_mutex_lock(&btsnoop_lock);
+		btsnoop_flush_pending = false;
+	}
+
+	pthread_mutex_unlock(&btsnoop_lock);
+
+	return NULL;
+}
+
+static void setup_buffer(void)
+{
+	btsnoop_buf[0] = malloc(btsnoop_buf_size);
+	btsnoop_buf[1] = malloc(btsnoop_buf_size);
+	if (!btsnoop_buf[0] || !btsnoop_buf[1])
+		goto failed;
+
+	btsnoop_buf_len = 0;
+	btsnoop_buf_pkts = 0;
+	btsnoop_flush_pending = false;
+	btsnoop_flush_quit = false;
+
+	if (pthread_create(&btsnoop_flusher, NULL, flusher_thread, NULL))
+		goto failed;
+
+	return;
+
+failed:
+	fprintf(stderr, "Failed to setup write buffer\n");
+	free(btsnoop_buf[0]);
+	free(btsnoop_buf[1]);
+	btsnoop_buf[0] = NULL;
+	btsnoop_buf[1] = NULL;
+	btsnoop_buf_size = 0;
+}
+
+void btsnoop_set_buffer(size_t size)
+{
+	if (btsnoop_fd >= 0)
+		return;
+
+	if (size > 0 && size < BTSNOOP_BUF_MIN_SIZE)
+		size = BTSNOOP_BUF_MIN_SIZE;
+
+	btsnoop_buf_size = size;
+}
+
+void btsnoop_set_rotate(uint64_t size, unsigned int seconds)
+{
+	btsnoop_rotate_size = size;
+	btsnoop_rotate_secs = seconds;
+}
+
+void btsnoop_create(const char *path, uint32_t type)
+{
+	if (btsnoop_fd >= 0)
+		return;
+
+	btsnoop_type = type;
+
+	btsnoop_fd = create_file(path);
+	if (btsnoop_fd < 0)
+		return;
+
+	btsnoop_path = strdup(path);
+	btsnoop_file_num = 0;
+	btsnoop_drops = 0;
+
+	if (btsnoop_buf_size > 0)
+		setup_buffer();
+}
+
+int btsnoop_flush(void)
+{
+	int err = 0;
+
+	if (!btsnoop_buf_size || !btsnoop_buf_len)
+		return 0;
+
+	pthread_mutex_lock(&btsnoop_lock);
+
+	if (btsnoop_flush_pending) {
+		err = -EBUSY;
+	} else {
+		uint8_t *buf = btsnoop_buf[1];
+
+		btsnoop_buf[1] = btsnoop_buf[0];
+		btsnoop_buf[0] = buf;
+
+		btsnoop_flush_len = btsnoop_buf_len;
+		btsnoop_flush_pkts = btsnoop_buf_pkts;
+		btsnoop_flush_pending = true;
+		pthread_cond_signal(&btsnoop_cond);
+	}
+
+	pthread_mutex_unlock(&btsnoop_lock);
+
+	if (err < 0)
+		return err;
+
+	btsnoop_buf_len = 0;
+	btsnoop_buf_pkts = 0;
+
+	return 0;
 }
 
 void btsnoop_write(struct timeval *tv, uint32_t flags,
 					const void *data, uint16_t size)
 {
 	struct btsnoop_pkt pkt;
+	struct iovec iov[2];
 	uint64_t ts;
-	ssize_t written;
+	size_t len, written;
+	uint8_t *ptr;
 
 	ts = (tv->tv_sec - 946684800ll) * 1000000ll + tv->tv_usec;
 
 	pkt.size  = htonl(size);
 	pkt.len   = htonl(size);
 	pkt.flags = htonl(flags);
-	pkt.drops = htonl(0);
+	pkt.drops = htonl(__atomic_load_n(&btsnoop_drops, __ATOMIC_RELAXED));
 	pkt.ts    = hton64(ts + 0x00E03AB44A676000ll);
 
-	written = write(btsnoop_fd, &pkt, BTSNOOP_PKT_SIZE);
-	if (written < 0)
+	if (!data)
+		size = 0;
+
+	len = BTSNOOP_PKT_SIZE + size;
+
+	if (!btsnoop_buf_size) {
+		iov[0].iov_base = &pkt;
+		iov[0].iov_len = BTSNOOP_PKT_SIZE;
+		iov[1].iov_base = (void *) data;
+		iov[1].iov_len = size;
+
+		written = write_iov(iov, size > 0 ? 2 : 1, len);
+		if (written < len) {
+			truncate_record(written);
+			add_drops(1);
+		}
 		return;
+	}
 
-	if (data && size > 0) {
-		written = write(btsnoop_fd, data, size);
-		if (written < 0)
-			return;
+	if (btsnoop_buf_len + len > btsnoop_buf_size &&
+						btsnoop_flush() < 0) {
+		add_drops(1);
+		return;
 	}
+
+	ptr = btsnoop_buf[0] + btsnoop_buf_len;
+	memcpy(ptr, &pkt, BTSNOOP_PKT_SIZE);
+	if (size > 0)
+		memcpy(ptr + BTSNOOP_PKT_SIZE, data, size);
+
+	btsnoop_buf_len += len;
+	btsnoop_buf_pkts++;
 }
 
 static uint32_t get_flags_from_opcode(uint16_t opcode)
@@ -199,6 +504,117 @@ void btsnoop_write_phy(struct timeval *tv, uint16_t frequency,
 	btsnoop_write(tv, flags, data, size);
 }
 
+/*
+ * Reader: regular files are memory mapped so records are decoded
+ * without a read() call per field.  Optionally an index with one entry
+ * per record is built, which allows seeking to a time window and
+ * skipping records of other controllers or connection handles without
+ * touching their payload.  It is only cached in a file if the caller
+ * names one.
+ */
+static uint8_t *btsnoop_map = NULL;
+static size_t btsnoop_map_size = 0;
+static size_t btsnoop_map_pos = 0;
+
+struct btsnoop_idx_hdr {
+	uint8_t		id[8];		/* Identification Pattern */
+	uint32_t	version;	/* Index Version = 1 */
+	uint32_t	type;		/* Datalink Type */
+	uint64_t	file_size;	/* Size of the indexed file */
+	int64_t		file_mtime;	/* Modification time of the file */
+	uint64_t	count;		/* Number of entries */
+} __attribute__ ((packed));
+#define BTSNOOP_IDX_HDR_SIZE (sizeof(struct btsnoop_idx_hdr))
+
+/* Entries are stored in host byte order, the index is a local cache */
+struct btsnoop_idx_entry {
+	uint64_t	offset;		/* Record offset in file */
+	uint64_t	ts;		/* Timestamp microseconds */
+	uint16_t	index;		/* Controller index */
+	uint16_t	opcode;		/* Monitor opcode */
+	uint16_t	handle;		/* Connection handle or 0xffff */
+	uint16_t	code;		/* HCI command opcode or event code */
+} __attribute__ ((packed));
+#define BTSNOOP_IDX_ENTRY_SIZE (sizeof(struct btsnoop_idx_entry))
+
+static const uint8_t btsnoop_idx_id[] = { 0x62, 0x74, 0x73, 0x6e,
+					  0x70, 0x69, 0x64, 0x78 };
+
+static const uint32_t btsnoop_idx_version = 1;
+
+static void *btsnoop_idx_map = NULL;
+static size_t btsnoop_idx_map_size = 0;
+static struct btsnoop_idx_entry *btsnoop_idx = NULL;
+static uint64_t btsnoop_idx_count = 0;
+static uint64_t btsnoop_idx_pos = 0;
+
+static uint16_t btsnoop_filter_index = 0xffff;
+static uint16_t btsnoop_filter_handle = 0xffff;
+static uint64_t btsnoop_filter_end = 0;
+
+static void release_index(void)
+{
+	if (btsnoop_idx_map)
+		munmap(btsnoop_idx_map, btsnoop_idx_map_size);
+	else
+		free(btsnoop_idx);
+
+	btsnoop_idx_map = NULL;
+	btsnoop_idx_map_size = 0;
+	btsnoop_idx = NULL;
+	btsnoop_idx_count = 0;
+	btsnoop_idx_pos = 0;
+}
+
+static void close_file(void)
+{
+	release_index();
+
+	if (btsnoop_map)
+		munmap(btsnoop_map, btsnoop_map_size);
+
+	btsnoop_map = NULL;
+	btsnoop_map_size = 0;
+	btsnoop_map_pos = 0;
+
+	close(btsnoop_fd);
+	btsnoop_fd = -1;
+}
+
+static ssize_t read_file(void *buf, size_t len)
+{
+	if (!btsnoop_map)
+		return read(btsnoop_fd, buf, len);
+
+	if (len > btsnoop_map_size - btsnoop_map_pos)
+		len = btsnoop_map_size - btsnoop_map_pos;
+
+	memcpy(buf, btsnoop_map + btsnoop_map_pos, len);
+	btsnoop_map_pos += len;
+
+	return len;
+}
+
+static void map_file(void)
+{
+	struct stat st;
+	void *map;
+
+	if (fstat(btsnoop_fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+							st.st_size <= 0)
+		return;
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, btsnoop_fd, 0);
+	if (map == MAP_FAILED)
+		return;
+
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	btsnoop_map = map;
+	btsnoop_map_size = st.st_size;
+	btsnoop_map_pos = 0;
+}
+
 int btsnoop_open(const char *path, uint32_t *type)
 {
 	struct btsnoop_hdr hdr;
@@ -215,25 +631,24 @@ int btsnoop_open(const char *path, uint32_t *type)
 		return -1;
 	}
 
-	len = read(btsnoop_fd, &hdr, BTSNOOP_HDR_SIZE);
+	map_file();
+
+	len = read_file(&hdr, BTSNOOP_HDR_SIZE);
 	if (len < 0 || len != BTSNOOP_HDR_SIZE) {
 		perror("Failed to read header");
-		close(btsnoop_fd);
-		btsnoop_fd = -1;
+		close_file();
 		return -1;
 	}
 
 	if (memcmp(hdr.id, btsnoop_id, sizeof(btsnoop_id))) {
 		fprintf(stderr, "Invalid btsnoop header\n");
-		close(btsnoop_fd);
-		btsnoop_fd = -1;
+		close_file();
 		return -1;
 	}
 
 	if (ntohl(hdr.version) != btsnoop_version) {
 		fprintf(stderr, "Invalid btsnoop version\n");
-		close(btsnoop_fd);
-		btsnoop_fd = -1;
+		close_file();
 		return -1;
 	}
 
@@ -280,6 +695,280 @@ static uint16_t get_opcode_from_flags(uint8_t type, uint32_t flags)
 	return 0xff;
 }
 
+static int load_index(const char *path, const struct stat *st)
+{
+	const struct btsnoop_idx_hdr *hdr;
+	struct btsnoop_idx_entry *entries;
+	struct stat idx_st;
+	uint64_t i;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &idx_st) < 0 || idx_st.st_size < BTSNOOP_IDX_HDR_SIZE) {
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, idx_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return -1;
+
+	hdr = map;
+	entries = (void *) ((uint8_t *) map + BTSNOOP_IDX_HDR_SIZE);
+
+	if (memcmp(hdr->id, btsnoop_idx_id, sizeof(btsnoop_idx_id)) ||
+			hdr->version != btsnoop_idx_version ||
+			hdr->type != btsnoop_type ||
+			hdr->file_size != (uint64_t) st->st_size ||
+			hdr->file_mtime != (int64_t) st->st_mtime ||
+			hdr->count > (UINT64_MAX - BTSNOOP_IDX_HDR_SIZE) /
+						BTSNOOP_IDX_ENTRY_SIZE ||
+			(uint64_t) idx_st.st_size != BTSNOOP_IDX_HDR_SIZE +
+				hdr->count * BTSNOOP_IDX_ENTRY_SIZE)
+		goto failed;
+
+	/* Every record header must lie inside the mapped file, a stale or
+	 * corrupt index is rebuilt by walking the file instead */
+	for (i = 0; i < hdr->count; i++) {
+		if (btsnoop_map_size < BTSNOOP_PKT_SIZE ||
+				entries[i].offset > btsnoop_map_size -
+							BTSNOOP_PKT_SIZE)
+			goto failed;
+	}
+
+	btsnoop_idx_map = map;
+	btsnoop_idx_map_size = idx_st.st_size;
+	btsnoop_idx = entries;
+	btsnoop_idx_count = hdr->count;
+
+	return 0;
+
+failed:
+	munmap(map, idx_st.st_size);
+	return -1;
+}
+
+static void save_index(const char *path, const struct stat *st)
+{
+	struct btsnoop_idx_hdr hdr;
+	char tmp[PATH_MAX];
+	struct iovec iov[2];
+	ssize_t written;
+	size_t len;
+	int fd;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int) sizeof(tmp))
+		return;
+
+	/* The index is only a cache, failing to write it is not an error */
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+				S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (fd < 0)
+		return;
+
+	memcpy(hdr.id, btsnoop_idx_id, sizeof(btsnoop_idx_id));
+	hdr.version = btsnoop_idx_version;
+	hdr.type = btsnoop_type;
+	hdr.file_size = st->st_size;
+	hdr.file_mtime = st->st_mtime;
+	hdr.count = btsnoop_idx_count;
+
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = BTSNOOP_IDX_HDR_SIZE;
+	iov[1].iov_base = btsnoop_idx;
+	iov[1].iov_len = btsnoop_idx_count * BTSNOOP_IDX_ENTRY_SIZE;
+
+	len = iov[0].iov_len + iov[1].iov_len;
+
+	written = writev(fd, iov, 2);
+	close(fd);
+
+	if (written < 0 || (size_t) written != len || rename(tmp, path) < 0)
+		unlink(tmp);
+}
+
+static void fill_entry(struct btsnoop_idx_entry *entry, uint32_t flags,
+				const uint8_t *data, uint32_t size)
+{
+	switch (btsnoop_type) {
+	case BTSNOOP_TYPE_HCI:
+		entry->index = 0;
+		entry->opcode = get_opcode_from_flags(0xff, flags);
+		break;
+	case BTSNOOP_TYPE_UART:
+		entry->index = 0;
+		entry->opcode = get_opcode_from_flags(size > 0 ? data[0] : 0,
+									flags);
+		if (size > 0) {
+			data++;
+			size--;
+		}
+		break;
+	case BTSNOOP_TYPE_EXTENDED_HCI:
+		entry->index = flags >> 16;
+		entry->opcode = flags & 0xffff;
+		break;
+	}
+
+	entry->handle = 0xffff;
+	entry->code = 0x0000;
+
+	switch (entry->opcode) {
+	case BTSNOOP_OPCODE_COMMAND_PKT:
+		if (size >= 2)
+			entry->code = data[0] | (data[1] << 8);
+		break;
+	case BTSNOOP_OPCODE_EVENT_PKT:
+		if (size >= 1)
+			entry->code = data[0];
+		break;
+	case BTSNOOP_OPCODE_ACL_TX_PKT:
+	case BTSNOOP_OPCODE_ACL_RX_PKT:
+	case BTSNOOP_OPCODE_SCO_TX_PKT:
+	case BTSNOOP_OPCODE_SCO_RX_PKT:
+		if (size >= 2)
+			entry->handle = (data[0] | (data[1] << 8)) & 0x0fff;
+		break;
+	}
+}
+
+static int build_index(void)
+{
+	struct btsnoop_idx_entry *entries = NULL;
+	uint64_t count = 0, alloc = 0;
+	size_t pos = BTSNOOP_HDR_SIZE;
+
+	while (pos + BTSNOOP_PKT_SIZE <= btsnoop_map_size) {
+		const struct btsnoop_pkt *pkt = (void *) (btsnoop_map + pos);
+		uint32_t len = ntohl(pkt->len);
+
+		if (len > btsnoop_map_size - pos - BTSNOOP_PKT_SIZE)
+			break;
+
+		if (count == alloc) {
+			struct btsnoop_idx_entry *tmp;
+
+			alloc = alloc ? alloc * 2 : 4096;
+			tmp = realloc(entries, alloc * BTSNOOP_IDX_ENTRY_SIZE);
+			if (!tmp) {
+				free(entries);
+				return -1;
+			}
+			entries = tmp;
+		}
+
+		entries[count].offset = pos;
+		entries[count].ts = ntoh64(pkt->ts);
+		fill_entry(&entries[count], ntohl(pkt->flags), pkt->data, len);
+		count++;
+
+		pos += BTSNOOP_PKT_SIZE + len;
+	}
+
+	btsnoop_idx = entries;
+	btsnoop_idx_count = count;
+
+	return 0;
+}
+
+int btsnoop_open_index(const char *idx_path)
+{
+	struct stat st;
+
+	if (!btsnoop_map || btsnoop_idx)
+		return -1;
+
+	switch (btsnoop_type) {
+	case BTSNOOP_TYPE_HCI:
+	case BTSNOOP_TYPE_UART:
+	case BTSNOOP_TYPE_EXTENDED_HCI:
+		break;
+	default:
+		return -1;
+	}
+
+	if (fstat(btsnoop_fd, &st) < 0)
+		return -1;
+
+	if (idx_path && load_index(idx_path, &st) == 0)
+		return 0;
+
+	if (build_index() < 0)
+		return -1;
+
+	if (idx_path)
+		save_index(idx_path, &st);
+
+	return 0;
+}
+
+void btsnoop_set_read_filter(uint16_t index, uint16_t handle)
+{
+	btsnoop_filter_index = index;
+	btsnoop_filter_handle = handle;
+}
+
+void btsnoop_set_read_window(uint64_t start, uint64_t end)
+{
+	uint64_t first, lo, hi;
+
+	if (!btsnoop_idx || !btsnoop_idx_count)
+		return;
+
+	first = btsnoop_idx[0].ts;
+
+	btsnoop_filter_end = end ? first + end : 0;
+
+	/* Find the first record at or after the start of the window */
+	lo = 0;
+	hi = btsnoop_idx_count;
+
+	while (lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+
+		if (btsnoop_idx[mid].ts < first + start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	btsnoop_idx_pos = lo;
+}
+
+static int next_entry(void)
+{
+	while (btsnoop_idx_pos < btsnoop_idx_count) {
+		const struct btsnoop_idx_entry *entry;
+
+		entry = &btsnoop_idx[btsnoop_idx_pos++];
+
+		if (btsnoop_filter_end && entry->ts > btsnoop_filter_end)
+			break;
+
+		if (btsnoop_filter_index != 0xffff &&
+					entry->index != btsnoop_filter_index)
+			continue;
+
+		if (btsnoop_filter_handle != 0xffff &&
+				entry->handle != 0xffff &&
+				entry->handle != btsnoop_filter_handle)
+			continue;
+
+		btsnoop_map_pos = entry->offset;
+		return 0;
+	}
+
+	btsnoop_idx_pos = btsnoop_idx_count;
+
+	return -1;
+}
+
 int btsnoop_read_hci(struct timeval *tv, uint16_t *index, uint16_t *opcode,
 						void *data, uint16_t *size)
 {
@@ -292,14 +981,16 @@ int btsnoop_read_hci(struct timeval *tv, uint16_t *index, uint16_t *opcode,
 	if (btsnoop_fd < 0)
 		return -1;
 
-	len = read(btsnoop_fd, &pkt, BTSNOOP_PKT_SIZE);
+	if (btsnoop_idx && next_entry() < 0)
+		return -1;
+
+	len = read_file(&pkt, BTSNOOP_PKT_SIZE);
 	if (len == 0)
 		return -1;
 
 	if (len < 0 || len != BTSNOOP_PKT_SIZE) {
 		perror("Failed to read packet");
-		close(btsnoop_fd);
-		btsnoop_fd = -1;
+		close_file();
 		return -1;
 	}
 
@@ -317,11 +1008,10 @@ int btsnoop_read_hci(struct timeval *tv, uint16_t *index, uint16_t *opcode,
 		break;
 
 	case BTSNOOP_TYPE_UART:
-		len = read(btsnoop_fd, &pkt_type, 1);
+		len = read_file(&pkt_type, 1);
 		if (len < 0) {
 			perror("Failed to read packet type");
-			close(btsnoop_fd);
-			btsnoop_fd = -1;
+			close_file();
 			return -1;
 		}
 		toread--;
@@ -337,16 +1027,14 @@ int btsnoop_read_hci(struct timeval *tv, uint16_t *index, uint16_t *opcode,
 
 	default:
 		fprintf(stderr, "Unknown packet type\n");
-		close(btsnoop_fd);
-		btsnoop_fd = -1;
+		close_file();
 		return -1;
 	}
 
-	len = read(btsnoop_fd, data, toread);
+	len = read_file(data, toread);
 	if (len < 0) {
 		perror("Failed to read data");
-		close(btsnoop_fd);
-		btsnoop_fd = -1;
+		close_file();
 		return -1;
 	}
 
@@ -366,14 +1054,13 @@ int btsnoop_read_phy(struct timeval *tv, uint16_t *frequency,
 	if (btsnoop_fd < 0)
 		return -1;
 
-	len = read(btsnoop_fd, &pkt, BTSNOOP_PKT_SIZE);
+	len = read_file(&pkt, BTSNOOP_PKT_SIZE);
 	if (len == 0)
 		return -1;
 
 	if (len < 0 || len != BTSNOOP_PKT_SIZE) {
 		perror("Failed to read packet");
-		close(btsnoop_fd);
-		btsnoop_fd = -1;
+		close_file();
 		return -1;
 	}
 
@@ -393,16 +1080,14 @@ int btsnoop_read_phy(struct timeval *tv, uint16_t *frequency,
 
 	default:
 		fprintf(stderr, "Unknown packet type\n");
-		close(btsnoop_fd);
-		btsnoop_fd = -1;
+		close_file();
 		return -1;
 	}
 
-	len = read(btsnoop_fd, data, toread);
+	len = read_file(data, toread);
 	if (len < 0) {
 		perror("Failed to read data");
-		close(btsnoop_fd);
-		btsnoop_fd = -1;
+		close_file();
 		return -1;
 	}
 
@@ -411,13 +1096,43 @@ int btsnoop_read_phy(struct timeval *tv, uint16_t *frequency,
 	return 0;
 }
 
+static void release_buffer(void)
+{
+	pthread_mutex_lock(&btsnoop_lock);
+	btsnoop_flush_quit = true;
+	pthread_cond_signal(&btsnoop_cond);
+	pthread_mutex_unlock(&btsnoop_lock);
+
+	pthread_join(btsnoop_flusher, NULL);
+
+	if (btsnoop_buf_len > 0)
+		add_drops(write_records(btsnoop_buf[0], btsnoop_buf_len,
+							btsnoop_buf_pkts));
+
+	free(btsnoop_buf[0]);
+	free(btsnoop_buf[1]);
+	btsnoop_buf[0] = NULL;
+	btsnoop_buf[1] = NULL;
+	btsnoop_buf_len = 0;
+	btsnoop_buf_pkts = 0;
+}
+
 void btsnoop_close(void)
 {
 	if (btsnoop_fd < 0)
 		return;
 
-	close(btsnoop_fd);
-	btsnoop_fd = -1;
+	if (btsnoop_buf[0])
+		release_buffer();
+
+	free(btsnoop_path);
+	btsnoop_path = NULL;
+
+	close_file();
 
 	btsnoop_index = 0xffff;
+
+	btsnoop_filter_index = 0xffff;
+	btsnoop_filter_handle = 0xffff;
+	btsnoop_filter_end = 0;
 }
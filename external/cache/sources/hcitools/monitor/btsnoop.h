@@ -23,6 +23,7 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 #include <sys/time.h>
 
 #define BTSNOOP_TYPE_HCI		1001
@@ -42,7 +43,10 @@
 #define BTSNOOP_OPCODE_SCO_TX_PKT	6
 #define BTSNOOP_OPCODE_SCO_RX_PKT	7
 
+void btsnoop_set_buffer(size_t size);
+void btsnoop_set_rotate(uint64_t size, unsigned int seconds);
 void btsnoop_create(const char *path, uint32_t type);
+int btsnoop_flush(void);
 void btsnoop_write(struct timeval *tv, uint32_t flags,
 					const void *data, uint16_t size);
 void btsnoop_write_hci(struct timeval *tv, uint16_t index, uint16_t opcode,
@@ -50,6 +54,9 @@ void btsnoop_write_hci(struct timeval *tv, uint16_t index, uint16_t opcode,
 void btsnoop_write_phy(struct timeval *tv, uint16_t frequency,
 					const void *data, uint16_t size);
 int btsnoop_open(const char *path, uint32_t *type);
+int btsnoop_open_index(const char *idx_path);
+void btsnoop_set_read_filter(uint16_t index, uint16_t handle);
+void btsnoop_set_read_window(uint64_t start, uint64_t end);
 int btsnoop_read_hci(struct timeval *tv, uint16_t *index, uint16_t *opcode,
 						void *data, uint16_t *size);
 int btsnoop_read_phy(struct timeval *tv, uint16_t *frequency,
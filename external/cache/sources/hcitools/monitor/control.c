@@ -808,12 +808,35 @@ void control_server(const char *path)
 	server_fd = fd;
 }
 
-void control_writer(const char *path)
+static void writer_flush_callback(int id, void *user_data)
 {
+	btsnoop_flush();
+
+	mainloop_modify_timeout(id, 1);
+}
+
+static void writer_destroy(void *user_data)
+{
+	/* Called when the mainloop exits, writes out pending packets */
+	btsnoop_close();
+}
+
+void control_writer(const char *path, size_t buffer_size,
+				uint64_t rotate_size, unsigned int rotate_secs)
+{
+	btsnoop_set_buffer(buffer_size);
+	btsnoop_set_rotate(rotate_size, rotate_secs);
+
 	btsnoop_create(path, BTSNOOP_TYPE_EXTENDED_HCI);
+
+	if (buffer_size > 0)
+		mainloop_add_timeout(1, writer_flush_callback, NULL,
+							writer_destroy);
 }
 
-void control_reader(const char *path)
+void control_reader(const char *path, const char *index_path,
+			uint16_t index, uint16_t handle,
+			uint64_t start, uint64_t end)
 {
 	unsigned char buf[MAX_PACKET_SIZE];
 	uint16_t pktlen;
@@ -823,6 +846,16 @@ void control_reader(const char *path)
 	if (btsnoop_open(path, &type) < 0)
 		return;
 
+	/* The controller filter alone is applied by the decoder */
+	if (handle != 0xffff || start || end || index_path) {
+		if (btsnoop_open_index(index_path) < 0) {
+			fprintf(stderr, "Failed to index file\n");
+		} else {
+			btsnoop_set_read_filter(index, handle);
+			btsnoop_set_read_window(start, end);
+		}
+	}
+
 	switch (type) {
 	case BTSNOOP_TYPE_HCI:
 	case BTSNOOP_TYPE_UART:
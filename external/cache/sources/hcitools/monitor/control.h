@@ -23,9 +23,13 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 
-void control_writer(const char *path);
-void control_reader(const char *path);
+void control_writer(const char *path, size_t buffer_size,
+				uint64_t rotate_size, unsigned int rotate_secs);
+void control_reader(const char *path, const char *index_path,
+			uint16_t index, uint16_t handle,
+			uint64_t start, uint64_t end);
 void control_server(const char *path);
 int control_tracing(void);
 
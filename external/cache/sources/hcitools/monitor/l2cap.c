@@ -28,6 +28,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include <inttypes.h>
 
 #include <bluetooth/bluetooth.h>
@@ -39,7 +41,18 @@
 #include "uuid.h"
 #include "sdp.h"
 
-#define MAX_CHAN 64
+/*
+ * Channels are kept in a growable array and found through two chained
+ * hash tables, one keyed by (index, handle, scid) and one keyed by
+ * (index, handle, dcid).  Channels created over AMP controllers can
+ * match frames of other handles, those are rare and searched linearly.
+ *
+ * A new channel takes the lowest free slot, found through a bitmap, so
+ * slot numbers (printed as the channel number and used to track SDP
+ * continuation state) are the same as with the old fixed table.
+ */
+#define CHAN_SCID 0
+#define CHAN_DCID 1
 
 struct chan_data {
 	uint16_t index;
@@ -49,40 +62,205 @@ struct chan_data {
 	uint16_t psm;
 	uint8_t  ctrlid;
 	uint8_t  mode;
+	bool     active;
+	int      next[2];
 };
 
-static struct chan_data chan_list[MAX_CHAN];
+static struct chan_data *chan_list = NULL;
+static int chan_size = 0;
+static int chan_used = 0;
+static int chan_count = 0;
+static int chan_amp_count = 0;
+static uint32_t *chan_free_map = NULL;
 
-static void assign_scid(const struct l2cap_frame *frame,
-				uint16_t scid, uint16_t psm, uint8_t ctrlid)
+static int *chan_hash[2];
+static unsigned int chan_hash_size = 0;
+
+static inline unsigned int chan_hash_slot(uint16_t index, uint16_t handle,
+								uint16_t cid)
 {
-	int i, n = -1;
+	uint32_t key;
 
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (n < 0 && chan_list[i].handle == 0x0000)
-			n = i;
+	key = ((uint32_t) index << 28) ^ ((uint32_t) handle << 16) ^ cid;
 
-		if (chan_list[i].index != frame->index)
-			continue;
+	return (key * 0x9e3779b1u) & (chan_hash_size - 1);
+}
 
-		if (chan_list[i].handle != frame->handle)
+static inline uint16_t chan_cid(const struct chan_data *chan, int type)
+{
+	return type == CHAN_SCID ? chan->scid : chan->dcid;
+}
+
+static void link_chan(int n, int type)
+{
+	struct chan_data *chan = &chan_list[n];
+	unsigned int slot;
+
+	chan->next[type] = -1;
+
+	if (!chan_cid(chan, type))
+		return;
+
+	slot = chan_hash_slot(chan->index, chan->handle, chan_cid(chan, type));
+	chan->next[type] = chan_hash[type][slot];
+	chan_hash[type][slot] = n;
+}
+
+static void unlink_chan(int n, int type)
+{
+	struct chan_data *chan = &chan_list[n];
+	unsigned int slot;
+	int *ptr;
+
+	if (!chan_cid(chan, type))
+		return;
+
+	slot = chan_hash_slot(chan->index, chan->handle, chan_cid(chan, type));
+
+	for (ptr = &chan_hash[type][slot]; *ptr >= 0;
+					ptr = &chan_list[*ptr].next[type]) {
+		if (*ptr == n) {
+			*ptr = chan->next[type];
+			break;
+		}
+	}
+}
+
+static int resize_chan_hash(unsigned int size)
+{
+	int *hash[2];
+	unsigned int i;
+	int n;
+
+	hash[0] = malloc(size * sizeof(int));
+	hash[1] = malloc(size * sizeof(int));
+	if (!hash[0] || !hash[1]) {
+		free(hash[0]);
+		free(hash[1]);
+		return -1;
+	}
+
+	for (i = 0; i < size; i++) {
+		hash[0][i] = -1;
+		hash[1][i] = -1;
+	}
+
+	free(chan_hash[0]);
+	free(chan_hash[1]);
+	chan_hash[0] = hash[0];
+	chan_hash[1] = hash[1];
+	chan_hash_size = size;
+
+	for (n = 0; n < chan_used; n++) {
+		if (!chan_list[n].active)
 			continue;
 
-		if (frame->in) {
-			if (chan_list[i].dcid == scid) {
-				n = i;
-				break;
-			}
-		} else {
-			if (chan_list[i].scid == scid) {
-				n = i;
-				break;
+		link_chan(n, CHAN_SCID);
+		link_chan(n, CHAN_DCID);
+	}
+
+	return 0;
+}
+
+static int new_chan(void)
+{
+	int i;
+
+	if (chan_count < chan_used) {
+		for (i = 0; i < (chan_used + 31) / 32; i++) {
+			if (chan_free_map[i]) {
+				int n = i * 32 + ffs(chan_free_map[i]) - 1;
+
+				chan_free_map[i] &= ~(1u << (n % 32));
+				return n;
 			}
 		}
 	}
 
-	if (n < 0)
-		return;
+	if (chan_used == chan_size) {
+		struct chan_data *list;
+		uint32_t *map;
+		int size = chan_size ? chan_size * 2 : 64;
+
+		map = realloc(chan_free_map, size / 32 * sizeof(*map));
+		if (!map)
+			return -1;
+
+		memset(map + chan_size / 32, 0,
+				(size - chan_size) / 32 * sizeof(*map));
+		chan_free_map = map;
+
+		list = realloc(chan_list, size * sizeof(*list));
+		if (!list)
+			return -1;
+
+		chan_list = list;
+		chan_size = size;
+	}
+
+	if ((unsigned int) chan_used >= chan_hash_size &&
+			resize_chan_hash(chan_hash_size ?
+					chan_hash_size * 2 : 64) < 0)
+		return -1;
+
+	return chan_used++;
+}
+
+static void del_chan(int n)
+{
+	unlink_chan(n, CHAN_SCID);
+	unlink_chan(n, CHAN_DCID);
+
+	if (chan_list[n].ctrlid)
+		chan_amp_count--;
+
+	chan_list[n].active = false;
+	chan_free_map[n / 32] |= 1u << (n % 32);
+	chan_count--;
+}
+
+static int lookup_chan(int type, uint16_t index, uint16_t handle,
+								uint16_t cid)
+{
+	int n;
+
+	if (!chan_count || !cid)
+		return -1;
+
+	n = chan_hash[type][chan_hash_slot(index, handle, cid)];
+
+	while (n >= 0) {
+		const struct chan_data *chan = &chan_list[n];
+
+		if (chan->index == index && chan->handle == handle &&
+						chan_cid(chan, type) == cid)
+			return n;
+
+		n = chan->next[type];
+	}
+
+	return -1;
+}
+
+static void assign_scid(const struct l2cap_frame *frame,
+				uint16_t scid, uint16_t psm, uint8_t ctrlid)
+{
+	int n;
+
+	/* a channel with the same source CID is replaced in its slot */
+	n = lookup_chan(frame->in ? CHAN_DCID : CHAN_SCID,
+					frame->index, frame->handle, scid);
+	if (n >= 0) {
+		unlink_chan(n, CHAN_SCID);
+		unlink_chan(n, CHAN_DCID);
+		if (chan_list[n].ctrlid)
+			chan_amp_count--;
+		chan_count--;
+	} else {
+		n = new_chan();
+		if (n < 0)
+			return;
+	}
 
 	memset(&chan_list[n], 0, sizeof(chan_list[n]));
 	chan_list[n].index = frame->index;
@@ -96,158 +274,106 @@ static void assign_scid(const struct l2cap_frame *frame,
 	chan_list[n].psm = psm;
 	chan_list[n].ctrlid = ctrlid;
 	chan_list[n].mode = 0;
+	chan_list[n].active = true;
+
+	link_chan(n, CHAN_SCID);
+	link_chan(n, CHAN_DCID);
+
+	if (ctrlid)
+		chan_amp_count++;
+	chan_count++;
 }
 
 static void release_scid(const struct l2cap_frame *frame, uint16_t scid)
 {
-	int i;
-
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (chan_list[i].index != frame->index)
-			continue;
+	int n;
 
-		if (chan_list[i].handle != frame->handle)
-			continue;
-
-		if (frame->in) {
-			if (chan_list[i].scid == scid) {
-				chan_list[i].handle = 0;
-				break;
-			}
-		} else {
-			if (chan_list[i].dcid == scid) {
-				chan_list[i].handle = 0;
-				break;
-			}
-		}
-	}
+	n = lookup_chan(frame->in ? CHAN_SCID : CHAN_DCID,
+					frame->index, frame->handle, scid);
+	if (n >= 0)
+		del_chan(n);
 }
 
 static void assign_dcid(const struct l2cap_frame *frame,
 					uint16_t dcid, uint16_t scid)
 {
-	int i;
+	int n;
 
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (chan_list[i].index != frame->index)
-			continue;
+	if (frame->in) {
+		n = lookup_chan(CHAN_SCID, frame->index, frame->handle, scid);
+		if (n < 0)
+			return;
 
-		if (chan_list[i].handle != frame->handle)
-			continue;
+		unlink_chan(n, CHAN_DCID);
+		chan_list[n].dcid = dcid;
+		link_chan(n, CHAN_DCID);
+	} else {
+		n = lookup_chan(CHAN_DCID, frame->index, frame->handle, scid);
+		if (n < 0)
+			return;
 
-		if (frame->in) {
-			if (chan_list[i].scid == scid) {
-				chan_list[i].dcid = dcid;
-				break;
-			}
-		} else {
-			if (chan_list[i].dcid == scid) {
-				chan_list[i].scid = dcid;
-				break;
-			}
-		}
+		unlink_chan(n, CHAN_SCID);
+		chan_list[n].scid = dcid;
+		link_chan(n, CHAN_SCID);
 	}
 }
 
 static void assign_mode(const struct l2cap_frame *frame,
 					uint8_t mode, uint16_t dcid)
 {
-	int i;
+	int n;
 
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (chan_list[i].index != frame->index)
-			continue;
-
-		if (chan_list[i].handle != frame->handle)
-			continue;
-
-		if (frame->in) {
-			if (chan_list[i].scid == dcid) {
-				chan_list[i].mode = mode;
-				break;
-			}
-		} else {
-			if (chan_list[i].dcid == dcid) {
-				chan_list[i].mode = mode;
-				break;
-			}
-		}
-	}
+	n = lookup_chan(frame->in ? CHAN_SCID : CHAN_DCID,
+					frame->index, frame->handle, dcid);
+	if (n >= 0)
+		chan_list[n].mode = mode;
 }
 
-static uint16_t get_psm(const struct l2cap_frame *frame)
+static int find_chan(const struct l2cap_frame *frame)
 {
-	int i;
+	int type = frame->in ? CHAN_SCID : CHAN_DCID;
+	int n;
+
+	n = lookup_chan(type, frame->index, frame->handle, frame->cid);
+	if (n >= 0 || !chan_amp_count)
+		return n;
 
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (chan_list[i].index != frame->index &&
-					chan_list[i].ctrlid == 0)
+	for (n = 0; n < chan_used; n++) {
+		const struct chan_data *chan = &chan_list[n];
+
+		if (!chan->active || !chan->ctrlid)
 			continue;
 
-		if (chan_list[i].handle != frame->handle &&
-					chan_list[i].ctrlid != frame->index)
+		if (chan->handle != frame->handle &&
+					chan->ctrlid != frame->index)
 			continue;
 
-		if (frame->in) {
-			if (chan_list[i].scid == frame->cid)
-				return chan_list[i].psm;
-		} else {
-			if (chan_list[i].dcid == frame->cid)
-				return chan_list[i].psm;
-		}
+		if (chan_cid(chan, type) == frame->cid)
+			return n;
 	}
 
-	return 0;
+	return -1;
 }
 
-static uint8_t get_mode(const struct l2cap_frame *frame)
+static uint16_t get_psm(const struct l2cap_frame *frame)
 {
-	int i;
-
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (chan_list[i].index != frame->index &&
-					chan_list[i].ctrlid == 0)
-			continue;
+	int n = find_chan(frame);
 
-		if (chan_list[i].handle != frame->handle &&
-					chan_list[i].ctrlid != frame->index)
-			continue;
+	return n < 0 ? 0 : chan_list[n].psm;
+}
 
-		if (frame->in) {
-			if (chan_list[i].scid == frame->cid)
-				return chan_list[i].mode;
-		} else {
-			if (chan_list[i].dcid == frame->cid)
-				return chan_list[i].mode;
-		}
-	}
+static uint8_t get_mode(const struct l2cap_frame *frame)
+{
+	int n = find_chan(frame);
 
-	return 0;
+	return n < 0 ? 0 : chan_list[n].mode;
 }
 
 static uint16_t get_chan(const struct l2cap_frame *frame)
 {
-	int i;
+	int n = find_chan(frame);
 
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (chan_list[i].index != frame->index &&
-					chan_list[i].ctrlid == 0)
-			continue;
-
-		if (chan_list[i].handle != frame->handle &&
-					chan_list[i].ctrlid != frame->index)
-			continue;
-
-		if (frame->in) {
-			if (chan_list[i].scid == frame->cid)
-				return i;
-		} else {
-			if (chan_list[i].dcid == frame->cid)
-				return i;
-		}
-	}
-
-	return 0;
+	return n < 0 ? 0 : n;
 }
 
 #define MAX_INDEX 16
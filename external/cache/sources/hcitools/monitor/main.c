@@ -54,8 +54,14 @@ static void usage(void)
 	printf("options:\n"
 		"\t-r, --read <file>      Read traces in btsnoop format\n"
 		"\t-w, --write <file>     Save traces in btsnoop format\n"
+		"\t-b, --buffer <kb>      Buffer traces before writing\n"
+		"\t-z, --rotate-size <mb> Start a new trace file after size\n"
+		"\t-Z, --rotate-time <s>  Start a new trace file after time\n"
 		"\t-s, --server <socket>  Start monitor server socket\n"
 		"\t-i, --index <num>      Show only specified controller\n"
+		"\t-H, --handle <handle>  Show only data of specified handle\n"
+		"\t-W, --window <s>[,<s>] Show only traces in time window\n"
+		"\t-I, --index-file <f>   Load or save the index of traces\n"
 		"\t-t, --time             Show time instead of time offset\n"
 		"\t-T, --date             Show time and date information\n"
 		"\t-S, --sco              Dump SCO traffic\n"
@@ -65,8 +71,14 @@ static void usage(void)
 static const struct option main_options[] = {
 	{ "read",    required_argument, NULL, 'r' },
 	{ "write",   required_argument, NULL, 'w' },
+	{ "buffer",  required_argument, NULL, 'b' },
+	{ "rotate-size", required_argument, NULL, 'z' },
+	{ "rotate-time", required_argument, NULL, 'Z' },
 	{ "server",  required_argument, NULL, 's' },
 	{ "index",   required_argument, NULL, 'i' },
+	{ "handle",  required_argument, NULL, 'H' },
+	{ "window",  required_argument, NULL, 'W' },
+	{ "index-file", required_argument, NULL, 'I' },
 	{ "time",    no_argument,       NULL, 't' },
 	{ "date",    no_argument,       NULL, 'T' },
 	{ "sco",     no_argument,	NULL, 'S' },
@@ -79,6 +91,13 @@ int main(int argc, char *argv[])
 {
 	unsigned long filter_mask = 0;
 	const char *str, *reader_path = NULL, *writer_path = NULL;
+	const char *index_path = NULL;
+	size_t buffer_size = 0;
+	uint64_t rotate_size = 0;
+	unsigned int rotate_secs = 0;
+	uint16_t index = 0xffff, handle = 0xffff;
+	uint64_t window_start = 0, window_end = 0;
+	char *end;
 	sigset_t mask;
 
 	mainloop_init();
@@ -88,7 +107,7 @@ int main(int argc, char *argv[])
 	for (;;) {
 		int opt;
 
-		opt = getopt_long(argc, argv, "r:w:s:i:tTSvh",
+		opt = getopt_long(argc, argv, "r:w:b:z:Z:s:i:H:W:I:tTSvh",
 						main_options, NULL);
 		if (opt < 0)
 			break;
@@ -100,6 +119,15 @@ int main(int argc, char *argv[])
 		case 'w':
 			writer_path = optarg;
 			break;
+		case 'b':
+			buffer_size = strtoul(optarg, NULL, 0) * 1024;
+			break;
+		case 'z':
+			rotate_size = strtoull(optarg, NULL, 0) * 1024 * 1024;
+			break;
+		case 'Z':
+			rotate_secs = strtoul(optarg, NULL, 0);
+			break;
 		case 's':
 			control_server(optarg);
 			break;
@@ -112,7 +140,19 @@ int main(int argc, char *argv[])
 				usage();
 				return EXIT_FAILURE;
 			}
-			packet_select_index(atoi(str));
+			index = atoi(str);
+			packet_select_index(index);
+			break;
+		case 'H':
+			handle = strtoul(optarg, NULL, 0) & 0x0fff;
+			break;
+		case 'W':
+			window_start = strtod(optarg, &end) * 1000000;
+			if (*end == ',')
+				window_end = strtod(end + 1, NULL) * 1000000;
+			break;
+		case 'I':
+			index_path = optarg;
 			break;
 		case 't':
 			filter_mask &= ~PACKET_FILTER_SHOW_TIME_OFFSET;
@@ -153,12 +193,14 @@ int main(int argc, char *argv[])
 	packet_set_filter(filter_mask);
 
 	if (reader_path) {
-		control_reader(reader_path);
+		control_reader(reader_path, index_path, index, handle,
+						window_start, window_end);
 		return EXIT_SUCCESS;
 	}
 
 	if (writer_path)
-		control_writer(writer_path);
+		control_writer(writer_path, buffer_size,
+						rotate_size, rotate_secs);
 
 	if (control_tracing() < 0)
 		return EXIT_FAILURE;
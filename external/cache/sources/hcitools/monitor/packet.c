@@ -79,51 +79,44 @@ static bool index_filter = false;
 static uint16_t index_number = 0;
 static uint16_t index_current = 0;
 
-#define MAX_CONN 16
+/*
+ * Connection handles are 12 bits, so the link type is tracked in a
+ * directly indexed table instead of a short list that has to be
+ * searched for every packet.
+ */
+#define MAX_HANDLE 0x1000
 
-struct conn_data {
-	uint16_t handle;
-	uint8_t  type;
-};
+static uint8_t conn_type[MAX_HANDLE];
+static bool conn_type_init = false;
 
-static struct conn_data conn_list[MAX_CONN];
+static void init_conn_type(void)
+{
+	memset(conn_type, 0xff, sizeof(conn_type));
+	conn_type_init = true;
+}
 
 static void assign_handle(uint16_t handle, uint8_t type)
 {
-	int i;
+	if (!conn_type_init)
+		init_conn_type();
 
-	for (i = 0; i < MAX_CONN; i++) {
-		if (conn_list[i].handle == 0x0000) {
-			conn_list[i].handle = handle;
-			conn_list[i].type = type;
-			break;
-		}
-	}
+	conn_type[handle & 0x0fff] = type;
 }
 
 static void release_handle(uint16_t handle)
 {
-	int i;
+	if (!conn_type_init)
+		init_conn_type();
 
-	for (i = 0; i < MAX_CONN; i++) {
-		if (conn_list[i].handle == handle) {
-			conn_list[i].handle = 0x0000;
-			conn_list[i].type = 0x00;
-			break;
-		}
-	}
+	conn_type[handle & 0x0fff] = 0xff;
 }
 
 static uint8_t get_type(uint16_t handle)
 {
-	int i;
+	if (!conn_type_init)
+		return 0xff;
 
-	for (i = 0; i < MAX_CONN; i++) {
-		if (conn_list[i].handle == handle)
-			return conn_list[i].type;
-	}
-
-	return 0xff;
+	return conn_type[handle & 0x0fff];
 }
 
 void packet_set_filter(unsigned long filter)
@@ -5221,6 +5214,60 @@ static const struct opcode_data opcode_table[] = {
 	{ }
 };
 
+/*
+ * The opcode table is looked up for every command and command
+ * complete/status event, so it is hashed into an open addressing
+ * table on first use.  For duplicate opcodes the first entry wins,
+ * like with the linear search.
+ */
+#define OPCODE_HASH_BITS 10
+#define OPCODE_HASH_SIZE (1 << OPCODE_HASH_BITS)
+
+static const struct opcode_data *opcode_hash[OPCODE_HASH_SIZE];
+static bool opcode_hash_init = false;
+
+static inline unsigned int opcode_hash_slot(uint16_t opcode)
+{
+	return ((uint32_t) opcode * 0x9e3779b1u) >> (32 - OPCODE_HASH_BITS);
+}
+
+static void init_opcode_hash(void)
+{
+	int i;
+
+	for (i = 0; opcode_table[i].str; i++) {
+		unsigned int n = opcode_hash_slot(opcode_table[i].opcode);
+
+		while (opcode_hash[n] &&
+			opcode_hash[n]->opcode != opcode_table[i].opcode)
+			n = (n + 1) & (OPCODE_HASH_SIZE - 1);
+
+		if (!opcode_hash[n])
+			opcode_hash[n] = &opcode_table[i];
+	}
+
+	opcode_hash_init = true;
+}
+
+static const struct opcode_data *find_opcode_data(uint16_t opcode)
+{
+	unsigned int n;
+
+	if (!opcode_hash_init)
+		init_opcode_hash();
+
+	n = opcode_hash_slot(opcode);
+
+	while (opcode_hash[n]) {
+		if (opcode_hash[n]->opcode == opcode)
+			return opcode_hash[n];
+
+		n = (n + 1) & (OPCODE_HASH_SIZE - 1);
+	}
+
+	return NULL;
+}
+
 static const char *get_supported_command(int bit)
 {
 	int i;
@@ -5377,14 +5424,8 @@ static void cmd_complete_evt(const void *data, uint8_t size)
 	uint16_t ocf = cmd_opcode_ocf(opcode);
 	const struct opcode_data *opcode_data = NULL;
 	const char *opcode_color, *opcode_str;
-	int i;
 
-	for (i = 0; opcode_table[i].str; i++) {
-		if (opcode_table[i].opcode == opcode) {
-			opcode_data = &opcode_table[i];
-			break;
-		}
-	}
+	opcode_data = find_opcode_data(opcode);
 
 	if (opcode_data) {
 		if (opcode_data->rsp_func)
@@ -5430,14 +5471,8 @@ static void cmd_status_evt(const void *data, uint8_t size)
 	uint16_t ocf = cmd_opcode_ocf(opcode);
 	const struct opcode_data *opcode_data = NULL;
 	const char *opcode_color, *opcode_str;
-	int i;
 
-	for (i = 0; opcode_table[i].str; i++) {
-		if (opcode_table[i].opcode == opcode) {
-			opcode_data = &opcode_table[i];
-			break;
-		}
-	}
+	opcode_data = find_opcode_data(opcode);
 
 	if (opcode_data) {
 		opcode_color = COLOR_HCI_COMMAND;
@@ -6041,19 +6076,34 @@ static const struct subevent_data subevent_table[] = {
 	{ }
 };
 
+static const struct subevent_data *subevent_index[256];
+static bool subevent_index_init = false;
+
+static const struct subevent_data *find_subevent_data(uint8_t subevent)
+{
+	int i;
+
+	if (!subevent_index_init) {
+		for (i = 0; subevent_table[i].str; i++) {
+			uint8_t n = subevent_table[i].subevent;
+
+			if (!subevent_index[n])
+				subevent_index[n] = &subevent_table[i];
+		}
+
+		subevent_index_init = true;
+	}
+
+	return subevent_index[subevent];
+}
+
 static void le_meta_event_evt(const void *data, uint8_t size)
 {
 	uint8_t subevent = *((const uint8_t *) data);
 	const struct subevent_data *subevent_data = NULL;
 	const char *subevent_color, *subevent_str;
-	int i;
 
-	for (i = 0; subevent_table[i].str; i++) {
-		if (subevent_table[i].subevent == subevent) {
-			subevent_data = &subevent_table[i];
-			break;
-		}
-	}
+	subevent_data = find_subevent_data(subevent);
 
 	if (subevent_data) {
 		if (subevent_data->func)
@@ -6267,7 +6317,6 @@ void packet_hci_command(struct timeval *tv, uint16_t index,
 	const struct opcode_data *opcode_data = NULL;
 	const char *opcode_color, *opcode_str;
 	char extra_str[25];
-	int i;
 
 	if (size < HCI_COMMAND_HDR_SIZE) {
 		sprintf(extra_str, "(len %d)", size);
@@ -6280,12 +6329,7 @@ void packet_hci_command(struct timeval *tv, uint16_t index,
 	data += HCI_COMMAND_HDR_SIZE;
 	size -= HCI_COMMAND_HDR_SIZE;
 
-	for (i = 0; opcode_table[i].str; i++) {
-		if (opcode_table[i].opcode == opcode) {
-			opcode_data = &opcode_table[i];
-			break;
-		}
-	}
+	opcode_data = find_opcode_data(opcode);
 
 	if (opcode_data) {
 		if (opcode_data->cmd_func)
@@ -6325,6 +6369,27 @@ void packet_hci_command(struct timeval *tv, uint16_t index,
 	opcode_data->cmd_func(data, hdr->plen);
 }
 
+static const struct event_data *event_index[256];
+static bool event_index_init = false;
+
+static const struct event_data *find_event_data(uint8_t event)
+{
+	int i;
+
+	if (!event_index_init) {
+		for (i = 0; event_table[i].str; i++) {
+			uint8_t n = event_table[i].event;
+
+			if (!event_index[n])
+				event_index[n] = &event_table[i];
+		}
+
+		event_index_init = true;
+	}
+
+	return event_index[event];
+}
+
 void packet_hci_event(struct timeval *tv, uint16_t index,
 					const void *data, uint16_t size)
 {
@@ -6332,7 +6397,6 @@ void packet_hci_event(struct timeval *tv, uint16_t index,
 	const struct event_data *event_data = NULL;
 	const char *event_color, *event_str;
 	char extra_str[25];
-	int i;
 
 	if (size < HCI_EVENT_HDR_SIZE) {
 		sprintf(extra_str, "(len %d)", size);
@@ -6345,12 +6409,7 @@ void packet_hci_event(struct timeval *tv, uint16_t index,
 	data += HCI_EVENT_HDR_SIZE;
 	size -= HCI_EVENT_HDR_SIZE;
 
-	for (i = 0; event_table[i].str; i++) {
-		if (event_table[i].event == hdr->evt) {
-			event_data = &event_table[i];
-			break;
-		}
-	}
+	event_data = find_event_data(hdr->evt);
 
 	if (event_data) {
 		if (event_data->func)
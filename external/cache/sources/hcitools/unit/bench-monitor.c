@@ -0,0 +1,577 @@
+/*
+ *
+ *  packet_monitor() replay benchmark
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+/*
+ * Loads a trace into memory, either a btsnoop file (-r) or a synthetic
+ * one, and times its decoding through packet_monitor() with the output
+ * sent to /dev/null. The synthetic trace mixes commands with their
+ * Command Complete, LE advertising reports and ACL traffic that keeps
+ * opening and closing L2CAP channels on several handles, SDP included.
+ * With -w it is written out instead, so "btmon -r" output of two builds
+ * can be compared.
+ *
+ * The default trace stays within the 16 connection and 64 channel tables
+ * btmon used to have, so its output matches builds that still have them.
+ * With -c a trace with 40 live LE connections and 200 open channels is
+ * decoded once and the output checked: every LE link must still be known
+ * as LE and every data frame must still be matched to its channel.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "../monitor/btsnoop.h"
+#include "../monitor/packet.h"
+
+#define MAX_OPEN_CHAN	48
+#define NUM_HANDLES	4	/* BR/EDR, handles 1 to 4 */
+#define WIDE_OPEN_CHAN	200
+#define WIDE_LE_HANDLES	40	/* handles 0x0101 onwards */
+#define LE_HANDLE_BASE	0x0100
+
+struct record {
+	struct timeval tv;
+	uint16_t index;
+	uint16_t opcode;
+	uint16_t size;
+	uint8_t data[64];
+};
+
+struct chan {
+	uint16_t handle;
+	uint16_t local_cid;
+	uint16_t remote_cid;
+	uint16_t psm;
+};
+
+static struct record *records;
+static int num_records, max_records;
+
+static struct chan open_chan[WIDE_OPEN_CHAN];
+static int num_open, max_open = MAX_OPEN_CHAN;
+static int num_le_handles;
+static bool wide;
+static int num_data, num_sdp;
+static uint16_t next_cid = 0x0040;
+static uint8_t ident;
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(void)
+{
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return rnd_state >> 8;
+}
+
+static struct record *add_record(uint16_t opcode, const void *data,
+								uint16_t size)
+{
+	struct record *r;
+
+	if (num_records == max_records) {
+		max_records = max_records ? max_records * 2 : 4096;
+		records = realloc(records, max_records * sizeof(*records));
+		if (!records) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+
+	r = &records[num_records++];
+	r->tv.tv_sec = 1700000000 + num_records / 1000;
+	r->tv.tv_usec = (num_records % 1000) * 1000;
+	r->index = 0;
+	r->opcode = opcode;
+	r->size = size;
+	memcpy(r->data, data, size);
+
+	return r;
+}
+
+static void add_acl(bool in, uint16_t handle, uint16_t cid,
+					const uint8_t *payload, uint8_t len)
+{
+	uint8_t buf[64];
+
+	buf[0] = handle & 0xff;
+	buf[1] = 0x20 | (handle >> 8);
+	buf[2] = len + 4;
+	buf[3] = 0;
+	buf[4] = len;
+	buf[5] = 0;
+	buf[6] = cid & 0xff;
+	buf[7] = cid >> 8;
+	memcpy(buf + 8, payload, len);
+
+	add_record(in ? BTSNOOP_OPCODE_ACL_RX_PKT : BTSNOOP_OPCODE_ACL_TX_PKT,
+							buf, len + 8);
+}
+
+/* L2CAP signalling command carrying two CIDs and optional extra bytes */
+static void add_sig(bool in, uint16_t handle, uint8_t code, uint16_t cid1,
+					uint16_t cid2, int extra)
+{
+	uint8_t buf[16];
+
+	memset(buf, 0, sizeof(buf));
+	buf[0] = code;
+	buf[1] = ++ident;
+	buf[2] = 4 + extra;
+	buf[4] = cid1 & 0xff;
+	buf[5] = cid1 >> 8;
+	buf[6] = cid2 & 0xff;
+	buf[7] = cid2 >> 8;
+
+	add_acl(in, handle, 0x0001, buf, 8 + extra);
+}
+
+static void open_channel(void)
+{
+	struct chan *c = &open_chan[num_open++];
+	bool remote = rnd() & 1;
+
+	c->handle = 1 + rnd() % NUM_HANDLES;
+	c->local_cid = next_cid;
+	c->remote_cid = next_cid + 0x0400;
+	c->psm = (rnd() % 3) ? 0x0001 : 0x0019;	/* SDP or AVDTP */
+	if (++next_cid == 0x0400)
+		next_cid = 0x0040;
+
+	/* Connection Request: PSM, source CID */
+	add_sig(remote, c->handle, 0x02, c->psm,
+			remote ? c->remote_cid : c->local_cid, 0);
+	/* Connection Response: destination and source CID, result, status */
+	if (remote)
+		add_sig(false, c->handle, 0x03, c->local_cid,
+						c->remote_cid, 4);
+	else
+		add_sig(true, c->handle, 0x03, c->remote_cid,
+						c->local_cid, 4);
+}
+
+static void close_channel(void)
+{
+	int n = rnd() % num_open;
+	struct chan *c = &open_chan[n];
+	bool remote = rnd() & 1;
+
+	/* Disconnection Request and Response: destination, source CID */
+	if (remote) {
+		add_sig(true, c->handle, 0x06, c->local_cid, c->remote_cid, 0);
+		add_sig(false, c->handle, 0x07, c->local_cid, c->remote_cid, 0);
+	} else {
+		add_sig(false, c->handle, 0x06, c->remote_cid, c->local_cid, 0);
+		add_sig(true, c->handle, 0x07, c->remote_cid, c->local_cid, 0);
+	}
+
+	open_chan[n] = open_chan[--num_open];
+}
+
+static void channel_data(void)
+{
+	static const uint8_t sdp_req[] = {
+		0x06, 0x00, 0x01, 0x00, 0x0f,
+		0x35, 0x03, 0x19, 0x01, 0x00, 0x00, 0x40,
+		0x35, 0x05, 0x0a, 0x00, 0x00, 0xff, 0xff, 0x00 };
+	/* no continuation state, sdp.c overruns cont_list on those */
+	static const uint8_t sdp_rsp[] = {
+		0x07, 0x00, 0x01, 0x00, 0x0d, 0x00, 0x0a,
+		0x35, 0x08, 0x09, 0x00, 0x00, 0x0a, 0x00, 0x01, 0x00, 0x00,
+		0x00 };
+	static const uint8_t sdp_rsp2[] = {
+		0x07, 0x00, 0x01, 0x00, 0x0d, 0x00, 0x0a,
+		0x35, 0x08, 0x09, 0x00, 0x01, 0x0a, 0x00, 0x00, 0x00, 0x01,
+		0x00 };
+	static const uint8_t raw[] = {
+		0x80, 0x60, 0x12, 0x34, 0x00, 0x00, 0x00, 0x01 };
+	struct chan *c = &open_chan[rnd() % num_open];
+
+	if (c->psm == 0x0001) {
+		num_data += 2;
+		num_sdp += 2;
+		add_acl(false, c->handle, c->remote_cid, sdp_req,
+							sizeof(sdp_req));
+		if (rnd() & 1)
+			add_acl(true, c->handle, c->local_cid, sdp_rsp,
+							sizeof(sdp_rsp));
+		else
+			add_acl(true, c->handle, c->local_cid, sdp_rsp2,
+							sizeof(sdp_rsp2));
+	} else {
+		bool in = rnd() & 1;
+
+		num_data++;
+		add_acl(in, c->handle, in ? c->local_cid : c->remote_cid,
+							raw, sizeof(raw));
+	}
+}
+
+static void add_command(void)
+{
+	static const uint16_t opcodes[] = {
+		0x0c03, 0x1001, 0x1009, 0x0c14, 0x2008, 0x200b, 0x201f,
+		0x0405, 0x0c13, 0x2016 };
+	uint16_t opcode = opcodes[rnd() % (sizeof(opcodes) / 2)];
+	uint8_t buf[16];
+
+	memset(buf, 0, sizeof(buf));
+	buf[0] = opcode & 0xff;
+	buf[1] = opcode >> 8;
+	buf[2] = 0;
+	add_record(BTSNOOP_OPCODE_COMMAND_PKT, buf, 3);
+
+	/* Command Complete with status only */
+	buf[0] = 0x0e;
+	buf[1] = 4;
+	buf[2] = 1;
+	buf[3] = opcode & 0xff;
+	buf[4] = opcode >> 8;
+	buf[5] = 0;
+	add_record(BTSNOOP_OPCODE_EVENT_PKT, buf, 6);
+}
+
+static void add_adv_report(void)
+{
+	uint8_t buf[40];
+
+	memset(buf, 0, sizeof(buf));
+	buf[0] = 0x3e;		/* LE Meta Event */
+	buf[1] = 12 + 11;
+	buf[2] = 0x02;		/* LE Advertising Report */
+	buf[3] = 1;
+	buf[4] = rnd() % 5;
+	buf[5] = rnd() & 1;
+	buf[6] = rnd();
+	buf[11] = 0xc0;
+	buf[12] = 10;
+	buf[13] = 2;		/* Flags */
+	buf[14] = 0x01;
+	buf[15] = 0x06;
+	buf[16] = 6;		/* Complete Local Name */
+	buf[17] = 0x09;
+	memcpy(buf + 18, "bench", 5);
+	buf[23] = 0;
+	buf[24] = 0xc5;		/* RSSI */
+	add_record(BTSNOOP_OPCODE_EVENT_PKT, buf, 25);
+}
+
+static void add_le_conn(uint16_t handle)
+{
+	uint8_t buf[21];
+
+	memset(buf, 0, sizeof(buf));
+	buf[0] = 0x3e;		/* LE Meta Event */
+	buf[1] = 19;
+	buf[2] = 0x01;		/* LE Connection Complete */
+	buf[4] = handle & 0xff;
+	buf[5] = handle >> 8;
+	buf[8] = handle;	/* peer address */
+	buf[13] = 0xc0;
+	buf[14] = 0x18;		/* interval */
+	buf[18] = 0x48;		/* supervision timeout */
+	add_record(BTSNOOP_OPCODE_EVENT_PKT, buf, sizeof(buf));
+}
+
+static void add_encr_change(uint16_t handle)
+{
+	uint8_t buf[6];
+
+	buf[0] = 0x08;		/* Encryption Change */
+	buf[1] = 4;
+	buf[2] = 0;
+	buf[3] = handle & 0xff;
+	buf[4] = handle >> 8;
+	buf[5] = 0x01;
+	add_record(BTSNOOP_OPCODE_EVENT_PKT, buf, sizeof(buf));
+}
+
+static void make_trace(int count)
+{
+	uint8_t buf[16];
+	int i;
+
+	memset(buf, 0, sizeof(buf));
+	buf[0] = 0;		/* BR/EDR */
+	buf[1] = 1;		/* USB */
+	memcpy(buf + 8, "hci0", 4);
+	add_record(BTSNOOP_OPCODE_NEW_INDEX, buf, 16);
+
+	/* Connection Complete for every ACL handle */
+	for (i = 1; i <= NUM_HANDLES; i++) {
+		memset(buf, 0, sizeof(buf));
+		buf[0] = 0x03;
+		buf[1] = 11;
+		buf[3] = i;
+		buf[5] = i;
+		buf[11] = 0x01;
+		add_record(BTSNOOP_OPCODE_EVENT_PKT, buf, 13);
+	}
+
+	for (i = 1; i <= num_le_handles; i++)
+		add_le_conn(LE_HANDLE_BASE + i);
+
+	/* Fill the channel table up front, the churn alone hovers around
+	 * a few open channels */
+	if (wide)
+		while (num_open < max_open)
+			open_channel();
+
+	while (num_records < count) {
+		uint32_t r = rnd() % 100;
+
+		if (r < 10)
+			add_command();
+		else if (r < 25)
+			add_adv_report();
+		else if (r < 35 || num_open == 0)
+			num_open < max_open ? open_channel() : close_channel();
+		else if (r < 45)
+			close_channel();
+		else
+			channel_data();
+	}
+
+	/* Link types have to survive all the traffic above */
+	for (i = 1; i <= num_le_handles; i++)
+		add_encr_change(LE_HANDLE_BASE + i);
+	for (i = 1; i <= NUM_HANDLES; i++)
+		add_encr_change(i);
+}
+
+/* Decode the trace once into out and check what was lost on the way */
+static int check_trace(FILE *out)
+{
+	char line[1024];
+	int aes = 0, e0 = 0, sdp = 0, chans = 0, known = 0, max_chan = -1;
+	int saved, i;
+
+	fflush(stdout);
+	saved = dup(STDOUT_FILENO);
+	if (saved < 0 || dup2(fileno(out), STDOUT_FILENO) < 0) {
+		perror("dup");
+		return -1;
+	}
+
+	for (i = 0; i < num_records; i++)
+		packet_monitor(&records[i].tv, records[i].index,
+				records[i].opcode, records[i].data,
+				records[i].size);
+
+	fflush(stdout);
+	dup2(saved, STDOUT_FILENO);
+	close(saved);
+
+	rewind(out);
+
+	while (fgets(line, sizeof(line), out)) {
+		const char *p;
+
+		if (strstr(line, "Encryption: Enabled with AES-CCM"))
+			aes++;
+		else if (strstr(line, "Encryption: Enabled with E0"))
+			e0++;
+		else if (strstr(line, "SDP: Service Search Attribute"))
+			sdp++;
+
+		if (!strstr(line, "Channel: "))
+			continue;
+
+		chans++;
+
+		/* a lost channel decodes as PSM 0 in slot 0 */
+		p = strstr(line, "{chan ");
+		if (!strstr(line, "[PSM ") || strstr(line, "[PSM 0 ") || !p)
+			continue;
+
+		known++;
+		if (atoi(p + 6) > max_chan)
+			max_chan = atoi(p + 6);
+	}
+
+	fprintf(stderr, "%d records, %d/%d LE and %d/%d BR/EDR links, "
+			"%d/%d data frames on a channel, %d/%d SDP, "
+			"highest {chan %d}\n",
+			num_records, aes, num_le_handles, e0, NUM_HANDLES,
+			known, num_data, sdp, num_sdp, max_chan);
+
+	if (aes != num_le_handles || e0 != NUM_HANDLES ||
+			chans != num_data || known != num_data ||
+			sdp != num_sdp || max_chan < 64)
+		return -1;
+
+	return 0;
+}
+
+static void load_trace(const char *path)
+{
+	struct record r;
+
+	if (btsnoop_open(path, NULL) < 0)
+		exit(1);
+
+	while (btsnoop_read_hci(&r.tv, &r.index, &r.opcode, r.data,
+							&r.size) == 0) {
+		struct record *n;
+
+		if (r.size > sizeof(r.data))
+			continue;
+
+		n = add_record(r.opcode, r.data, r.size);
+		n->tv = r.tv;
+		n->index = r.index;
+	}
+
+	btsnoop_close();
+}
+
+static void usage(void)
+{
+	printf("bench-monitor - packet_monitor() replay benchmark\n"
+		"Usage:\n");
+	printf("\tbench-monitor [options]\n");
+	printf("options:\n"
+		"\t-r, --read <file>      Replay records from btsnoop file\n"
+		"\t-w, --write <file>     Write the synthetic trace and exit\n"
+		"\t-n, --records <num>    Synthetic trace length (default 400000,\n"
+		"\t                       50000 with -c)\n"
+		"\t-l, --loops <num>      Replays, the fastest is reported (default 3)\n"
+		"\t-c, --check            Check decoding past the old table sizes\n"
+		"\t-h, --help             Show help options\n");
+}
+
+static const struct option main_options[] = {
+	{ "read",    required_argument, NULL, 'r' },
+	{ "write",   required_argument, NULL, 'w' },
+	{ "records", required_argument, NULL, 'n' },
+	{ "loops",   required_argument, NULL, 'l' },
+	{ "check",   no_argument,       NULL, 'c' },
+	{ "help",    no_argument,       NULL, 'h' },
+	{ }
+};
+
+int main(int argc, char *argv[])
+{
+	const char *reader_path = NULL, *writer_path = NULL;
+	int count = 0, loops = 3;
+	bool check = false;
+	double best = 0;
+	int i, n;
+
+	for (;;) {
+		int opt;
+
+		opt = getopt_long(argc, argv, "r:w:n:l:ch", main_options, NULL);
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'r':
+			reader_path = optarg;
+			break;
+		case 'w':
+			writer_path = optarg;
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		case 'c':
+			check = true;
+			break;
+		case 'h':
+			usage();
+			return 0;
+		default:
+			return 1;
+		}
+	}
+
+	if (check) {
+		wide = true;
+		max_open = WIDE_OPEN_CHAN;
+		num_le_handles = WIDE_LE_HANDLES;
+	}
+
+	if (!count)
+		count = check ? 50000 : 400000;
+
+	/* the check needs to know what the trace holds */
+	if (reader_path && !check)
+		load_trace(reader_path);
+	else
+		make_trace(count);
+
+	if (writer_path) {
+		btsnoop_create(writer_path, BTSNOOP_TYPE_EXTENDED_HCI);
+		for (i = 0; i < num_records; i++)
+			btsnoop_write_hci(&records[i].tv, records[i].index,
+					records[i].opcode, records[i].data,
+					records[i].size);
+		btsnoop_close();
+		return 0;
+	}
+
+	packet_set_filter(PACKET_FILTER_SHOW_TIME_OFFSET);
+
+	if (check) {
+		FILE *out = tmpfile();
+
+		if (!out) {
+			perror("tmpfile");
+			return 1;
+		}
+
+		n = check_trace(out);
+		fclose(out);
+
+		printf("bench-monitor check %s\n", n < 0 ? "FAIL" : "pass");
+		return n < 0 ? 1 : 0;
+	}
+
+	if (!freopen("/dev/null", "w", stdout)) {
+		perror("/dev/null");
+		return 1;
+	}
+
+	for (n = 0; n < loops; n++) {
+		struct timespec start, end;
+		double elapsed;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < num_records; i++)
+			packet_monitor(&records[i].tv, records[i].index,
+					records[i].opcode, records[i].data,
+					records[i].size);
+		fflush(stdout);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		elapsed = (end.tv_sec - start.tv_sec) +
+				(end.tv_nsec - start.tv_nsec) / 1e9;
+		if (n == 0 || elapsed < best)
+			best = elapsed;
+	}
+
+	fprintf(stderr, "%d records, %.3f s, %.0f ns per record\n",
+			num_records, best, best * 1e9 / num_records);
+
+	return 0;
+}
@@ -0,0 +1,284 @@
+/*
+ *
+ *  HCI command queue event matching test
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+/*
+ * The device descriptor is one end of a SOCK_SEQPACKET socketpair and the
+ * test writes controller events into the other end. Socket filters do not
+ * apply to a socketpair, so HCI_FILTER get/set is stubbed out.
+ */
+
+#include <errno.h>
+#include <sys/poll.h>
+#include <sys/socket.h>
+
+static int filter_calls;
+
+static int stub_sockopt(void)
+{
+	filter_calls++;
+	return 0;
+}
+
+static int poll_fail;
+
+static int stub_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	if (poll_fail) {
+		errno = EBADF;
+		return -1;
+	}
+
+	return poll(fds, nfds, timeout);
+}
+
+#define getsockopt(a, b, c, d, e) ((void) (e), stub_sockopt())
+#define setsockopt(a, b, c, d, e) stub_sockopt()
+#define poll(a, b, c) stub_poll(a, b, c)
+#include "../lib/hci.c"
+#undef getsockopt
+#undef setsockopt
+#undef poll
+
+static int dev, ctrl, failed;
+
+#define CHECK(cond) do {						\
+	if (!(cond)) {							\
+		printf("FAIL %s:%d: %s\n", __func__, __LINE__, #cond);	\
+		failed++;						\
+	}								\
+} while (0)
+
+static void send_evt(uint8_t evt, const void *data, int len)
+{
+	unsigned char buf[HCI_MAX_EVENT_SIZE];
+
+	buf[0] = HCI_EVENT_PKT;
+	buf[1] = evt;
+	buf[2] = len;
+	memcpy(buf + 3, data, len);
+	if (write(ctrl, buf, 3 + len) != 3 + len)
+		failed++;
+}
+
+static void send_cmd_status(uint16_t ogf, uint16_t ocf)
+{
+	evt_cmd_status cs;
+
+	cs.status = 0;
+	cs.ncmd = 1;
+	cs.opcode = htobs(cmd_opcode_pack(ogf, ocf));
+	send_evt(EVT_CMD_STATUS, &cs, sizeof(cs));
+}
+
+static void send_le_meta(uint8_t subevent, const void *data, int len)
+{
+	unsigned char buf[HCI_MAX_EVENT_SIZE];
+
+	buf[0] = subevent;
+	memcpy(buf + 1, data, len);
+	send_evt(EVT_LE_META_EVENT, buf, 1 + len);
+}
+
+static void drain_commands(void)
+{
+	unsigned char buf[HCI_MAX_EVENT_SIZE];
+
+	while (recv(ctrl, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+		;
+}
+
+struct result {
+	int done;
+	int err;
+};
+
+static void req_done(int err, struct hci_request *r, void *user_data)
+{
+	struct result *res = user_data;
+
+	res->err = err;
+	res->done++;
+}
+
+/* LE subevents 0x07, 0x0e and 0x0f must not be taken for Remote Name
+ * Request Complete, Command Complete or Command Status. */
+static void test_le_meta_subevents(void)
+{
+	struct hci_cmd_queue *q;
+	struct hci_request name_rq, conn_rq, nop_rq;
+	remote_name_req_cp name_cp;
+	evt_remote_name_req_complete name_rp;
+	le_create_connection_cp conn_cp;
+	evt_le_connection_complete conn_rp;
+	unsigned char nop_rp[4], data[16];
+	struct result name_res = { 0, 0 }, conn_res = { 0, 0 }, nop_res = { 0, 0 };
+
+	q = hci_cmd_queue_new(dev);
+	CHECK(q != NULL);
+
+	memset(&name_cp, 0, sizeof(name_cp));
+	str2ba("00:11:22:33:44:55", &name_cp.bdaddr);
+	memset(&name_rq, 0, sizeof(name_rq));
+	name_rq.ogf = OGF_LINK_CTL;
+	name_rq.ocf = OCF_REMOTE_NAME_REQ;
+	name_rq.cparam = &name_cp;
+	name_rq.clen = REMOTE_NAME_REQ_CP_SIZE;
+	name_rq.event = EVT_REMOTE_NAME_REQ_COMPLETE;
+	name_rq.rparam = &name_rp;
+	name_rq.rlen = EVT_REMOTE_NAME_REQ_COMPLETE_SIZE;
+
+	memset(&conn_cp, 0, sizeof(conn_cp));
+	memset(&conn_rq, 0, sizeof(conn_rq));
+	conn_rq.ogf = OGF_LE_CTL;
+	conn_rq.ocf = OCF_LE_CREATE_CONN;
+	conn_rq.cparam = &conn_cp;
+	conn_rq.clen = LE_CREATE_CONN_CP_SIZE;
+	conn_rq.event = EVT_LE_CONN_COMPLETE;
+	conn_rq.rparam = &conn_rp;
+	conn_rq.rlen = EVT_LE_CONN_COMPLETE_SIZE;
+
+	/* a NOP, opcode 0x0000 */
+	memset(&nop_rq, 0, sizeof(nop_rq));
+	nop_rq.rparam = nop_rp;
+	nop_rq.rlen = sizeof(nop_rp);
+
+	CHECK(hci_cmd_queue_send(q, &name_rq, 1000, req_done, &name_res) == 0);
+	send_cmd_status(OGF_LINK_CTL, OCF_REMOTE_NAME_REQ);
+	hci_cmd_queue_process(q);
+	CHECK(hci_cmd_queue_send(q, &conn_rq, 1000, req_done, &conn_res) == 0);
+	send_cmd_status(OGF_LE_CTL, OCF_LE_CREATE_CONN);
+	hci_cmd_queue_process(q);
+	CHECK(hci_cmd_queue_send(q, &nop_rq, 1000, req_done, &nop_res) == 0);
+	hci_cmd_queue_process(q);
+	drain_commands();
+
+	/* subevent 0x07 carrying the bdaddr where a remote name would have it */
+	memset(data, 0, sizeof(data));
+	bacpy((bdaddr_t *) (data + 1), &name_cp.bdaddr);
+	send_le_meta(EVT_REMOTE_NAME_REQ_COMPLETE, data, sizeof(data));
+	/* subevents 0x0e and 0x0f with a zero "opcode" */
+	memset(data, 0, sizeof(data));
+	send_le_meta(EVT_CMD_COMPLETE, data, sizeof(data));
+	send_le_meta(EVT_CMD_STATUS, data, sizeof(data));
+	/* truncated LE Meta */
+	send_evt(EVT_LE_META_EVENT, data, 0);
+	hci_cmd_queue_process(q);
+
+	CHECK(name_res.done == 0);
+	CHECK(conn_res.done == 0);
+	CHECK(nop_res.done == 0);
+	CHECK(hci_cmd_queue_pending(q) == 3);
+
+	/* the real events still complete their requests */
+	memset(data, 0, sizeof(data));
+	data[0] = 0;
+	data[1] = 0x42;
+	send_le_meta(EVT_LE_CONN_COMPLETE, data, EVT_LE_CONN_COMPLETE_SIZE);
+	hci_cmd_queue_process(q);
+	CHECK(conn_res.done == 1 && conn_res.err == 0);
+	CHECK(conn_rp.handle == 0x42);
+
+	memset(&name_rp, 0, sizeof(name_rp));
+	bacpy(&name_rp.bdaddr, &name_cp.bdaddr);
+	strcpy((char *) name_rp.name, "peer");
+	send_evt(EVT_REMOTE_NAME_REQ_COMPLETE, &name_rp, sizeof(name_rp));
+	hci_cmd_queue_process(q);
+	CHECK(name_res.done == 1 && name_res.err == 0);
+
+	memset(data, 0, sizeof(data));
+	data[0] = 1;	/* ncmd */
+	send_evt(EVT_CMD_COMPLETE, data, EVT_CMD_COMPLETE_SIZE + 1);
+	hci_cmd_queue_process(q);
+	CHECK(nop_res.done == 1 && nop_res.err == 0);
+
+	CHECK(hci_cmd_queue_pending(q) == 0);
+	hci_cmd_queue_free(q);
+}
+
+/* hci_send_req() without and with a queue open on the descriptor */
+static void test_send_req(void)
+{
+	struct hci_cmd_queue *q;
+	read_local_name_rp rp;
+	unsigned char evt[EVT_CMD_COMPLETE_SIZE + sizeof(rp)];
+	uint16_t opcode = htobs(cmd_opcode_pack(OGF_HOST_CTL,
+							OCF_READ_LOCAL_NAME));
+	char name[249];
+	int i;
+
+	memset(evt, 0, sizeof(evt));
+	evt[0] = 1;
+	memcpy(evt + 1, &opcode, 2);
+	strcpy((char *) evt + EVT_CMD_COMPLETE_SIZE + 1, "fake");
+
+	for (i = 0; i < 2; i++) {
+		q = i ? hci_cmd_queue_new(dev) : NULL;
+
+		/* the reply is already waiting when the command goes out */
+		send_evt(EVT_CMD_COMPLETE, evt, sizeof(evt));
+		memset(name, 0, sizeof(name));
+		filter_calls = 0;
+		CHECK(hci_read_local_name(dev, sizeof(name), name, 1000) == 0);
+		CHECK(!strcmp(name, "fake"));
+
+		/* no queue: one filter get, set and restore, no queue setup;
+		 * open queue: its session filter is reused */
+		CHECK(filter_calls == (q ? 0 : 3));
+		CHECK(find_queue(dev) == q);
+		drain_commands();
+
+		hci_cmd_queue_free(q);
+	}
+}
+
+/* A failed wait must not leave the caller's stack request queued */
+static void test_send_req_error(void)
+{
+	struct hci_cmd_queue *q;
+	char name[249];
+
+	q = hci_cmd_queue_new(dev);
+	CHECK(q != NULL);
+
+	poll_fail = 1;
+	CHECK(hci_read_local_name(dev, sizeof(name), name, 1000) < 0);
+	CHECK(errno == EBADF);
+	poll_fail = 0;
+	CHECK(hci_cmd_queue_pending(q) == 0);
+	drain_commands();
+
+	hci_cmd_queue_free(q);
+}
+
+int main(int argc, char *argv[])
+{
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+		perror("socketpair");
+		return 1;
+	}
+	dev = sv[0];
+	ctrl = sv[1];
+
+	test_le_meta_subevents();
+	test_send_req();
+	test_send_req_error();
+
+	printf("test-hci-queue %s\n", failed ? "FAIL" : "pass");
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,411 @@
+/*
+ *
+ *  Realtek patch download test against a pty-backed fake controller
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+/*
+ * The host side runs hci_download_patch_h4() / hci_download_patch() in a
+ * child process on the slave end of a pty. The parent plays the controller
+ * on the master end: it checks that every fragment arrives once, in order
+ * and intact, answers each one with a vendor Command Complete after a fixed
+ * latency, and checks that the host never has more fragments outstanding
+ * than the Num_HCI_Command_Packets it was granted.
+ *
+ * With ncmd 0 the controller answers with no credits and grants one later
+ * with a NOP Command Complete; a fragment arriving in between is a failure.
+ */
+
+#include "../hciattach_rtk.c"
+
+#include <pty.h>
+#include <sys/wait.h>
+
+int set_speed(int fd, struct termios *ti, int speed)
+{
+	return 0;
+}
+
+#define TEST_FRAGS	200	/* enough to wrap the 7 bit patch index */
+#define TEST_LATENCY_MS	5
+#define TEST_NOP_MS	10
+#define TEST_TIMEOUT_MS	10000
+
+static uint8_t fw[TEST_FRAGS * PATCH_DATA_FIELD_MAX_SIZE];
+static struct patch_frag frags[TEST_FRAGS];
+
+struct reply {
+	long long due;
+	uint8_t index;
+	int nop;
+};
+
+struct controller {
+	int fd;
+	int proto;
+	int ncmd;
+	uint8_t txseq;		/* H5 */
+	uint8_t rxseq;		/* H5 */
+	uint8_t rx[8192];
+	int rxlen;
+	struct reply q[TEST_FRAGS * 2];
+	int qhead, qtail;
+	int expect;		/* next fragment */
+	int outstanding, max_outstanding;
+	int closed;		/* last event granted no credits */
+	int errors;
+};
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void make_frags(void)
+{
+	int i, len;
+
+	for (i = 0; i < (int) sizeof(fw); i++)
+		fw[i] = i * 7;	/* covers the SLIP escapes 0xc0 0xdb 0x11 0x13 */
+
+	for (i = 0; i < TEST_FRAGS; i++) {
+		len = i == TEST_FRAGS - 1 ? 100 : PATCH_DATA_FIELD_MAX_SIZE;
+		frags[i].index = i & 0x7f;
+		frags[i].len = len;
+		frags[i].data = fw + i * PATCH_DATA_FIELD_MAX_SIZE;
+	}
+	frags[TEST_FRAGS - 1].index |= 0x80;
+}
+
+static void send_event(struct controller *c, const uint8_t *evt, int len)
+{
+	uint8_t out[2 * (4 + 32) + 2];
+	uint8_t h[4];
+	int i, n = 0;
+
+	if (c->proto == HCI_UART_H4) {
+		out[n++] = HCI_EVENT_PKT;
+		memcpy(out + n, evt, len);
+		n += len;
+	} else {
+		h[0] = 0x80 | c->txseq | (c->rxseq << 3);
+		h[1] = ((len << 4) & 0xff) | HCI_EVENT_PKT;
+		h[2] = len >> 4;
+		h[3] = ~(h[0] + h[1] + h[2]);
+		c->txseq = (c->txseq + 1) & 0x07;
+
+		out[n++] = 0xc0;
+		for (i = 0; i < 4 + len; i++) {
+			uint8_t b = i < 4 ? h[i] : evt[i - 4];
+
+			if (b == 0xc0 || b == 0xdb || b == 0x11 || b == 0x13) {
+				out[n++] = 0xdb;
+				out[n++] = b == 0xc0 ? 0xdc : b == 0xdb ? 0xdd :
+						b == 0x11 ? 0xde : 0xdf;
+			} else
+				out[n++] = b;
+		}
+		out[n++] = 0xc0;
+	}
+
+	if (write(c->fd, out, n) != n)
+		c->errors++;
+}
+
+static void queue_reply(struct controller *c, uint8_t index, int nop, int delay)
+{
+	c->q[c->qtail].due = now_ms() + delay;
+	c->q[c->qtail].index = index;
+	c->q[c->qtail].nop = nop;
+	c->qtail++;
+}
+
+/* A vendor 0xfc20 command carrying one patch fragment */
+static void recv_fragment(struct controller *c, const uint8_t *cmd, int len)
+{
+	const struct patch_frag *f;
+
+	if (len < 4 || cmd[0] != 0x20 || cmd[1] != 0xfc || cmd[2] != len - 3) {
+		printf("bad command\n");
+		c->errors++;
+		return;
+	}
+
+	if (c->expect >= TEST_FRAGS) {
+		printf("extra fragment %d\n", cmd[3]);
+		c->errors++;
+		return;
+	}
+
+	f = &frags[c->expect];
+	if (cmd[3] != f->index || len - 4 != f->len ||
+				memcmp(cmd + 4, f->data, f->len)) {
+		printf("fragment %d: got index %d len %d\n", c->expect, cmd[3], len - 4);
+		c->errors++;
+	}
+
+	if (c->closed) {
+		printf("fragment %d sent without credits\n", c->expect);
+		c->errors++;
+	}
+
+	c->expect++;
+	c->outstanding++;
+	if (c->outstanding > c->max_outstanding)
+		c->max_outstanding = c->outstanding;
+
+	queue_reply(c, cmd[3], 0, TEST_LATENCY_MS);
+}
+
+static void parse_h4(struct controller *c)
+{
+	int plen;
+
+	while (c->rxlen >= 4) {
+		if (c->rx[0] != HCI_COMMAND_PKT) {
+			printf("unexpected h4 packet type %d\n", c->rx[0]);
+			c->errors++;
+			c->rxlen = 0;
+			return;
+		}
+
+		plen = c->rx[3];
+		if (c->rxlen < 4 + plen)
+			return;
+
+		recv_fragment(c, c->rx + 1, 3 + plen);
+		c->rxlen -= 4 + plen;
+		memmove(c->rx, c->rx + 4 + plen, c->rxlen);
+	}
+}
+
+static void parse_h5(struct controller *c)
+{
+	uint8_t pkt[1024];
+	int start, end, i, n, len;
+
+	for (;;) {
+		for (start = 0; start < c->rxlen && c->rx[start] != 0xc0; start++)
+			;
+		for (end = start + 1; end < c->rxlen && c->rx[end] != 0xc0; end++)
+			;
+		if (end >= c->rxlen) {
+			c->rxlen -= start;
+			memmove(c->rx, c->rx + start, c->rxlen);
+			return;
+		}
+
+		for (i = start + 1, n = 0; i < end; i++) {
+			if (c->rx[i] == 0xdb && i + 1 < end) {
+				i++;
+				pkt[n++] = c->rx[i] == 0xdc ? 0xc0 : c->rx[i] == 0xdd ? 0xdb :
+						c->rx[i] == 0xde ? 0x11 : 0x13;
+			} else
+				pkt[n++] = c->rx[i];
+		}
+
+		c->rxlen -= end;
+		memmove(c->rx, c->rx + end, c->rxlen);
+
+		if (n < 4)
+			continue;
+
+		len = (pkt[1] >> 4) | (pkt[2] << 4);
+		if ((pkt[1] & 0x0f) == HCI_COMMAND_PKT && (pkt[0] & 0x80) && n >= 4 + len) {
+			if ((pkt[0] & 0x07) != c->rxseq) {
+				printf("h5 seq %d, expected %d\n", pkt[0] & 0x07, c->rxseq);
+				c->errors++;
+			}
+			c->rxseq = ((pkt[0] & 0x07) + 1) & 0x07;
+			recv_fragment(c, pkt + 4, len);
+		}
+	}
+}
+
+/* Answer due fragments; ncmd 0 closes the window until a NOP reopens it */
+static void send_due(struct controller *c)
+{
+	uint8_t evt[8];
+	struct reply *r;
+
+	while (c->qhead < c->qtail && c->q[c->qhead].due <= now_ms()) {
+		r = &c->q[c->qhead++];
+
+		if (r->nop) {
+			evt[0] = 0x0e;	/* Command Complete */
+			evt[1] = 3;
+			evt[2] = 1;
+			evt[3] = 0x00;
+			evt[4] = 0x00;
+			c->closed = 0;
+			send_event(c, evt, 5);
+			continue;
+		}
+
+		evt[0] = 0x0e;	/* Command Complete */
+		evt[1] = 5;
+		evt[2] = c->ncmd;
+		evt[3] = 0x20;
+		evt[4] = 0xfc;
+		evt[5] = 0x00;
+		evt[6] = r->index;
+		c->outstanding--;
+		if (c->ncmd == 0) {
+			c->closed = 1;
+			queue_reply(c, 0, 1, TEST_NOP_MS);
+		}
+		send_event(c, evt, 7);
+	}
+}
+
+static int run_host(int proto, const char *tty, int tx_win)
+{
+	struct termios ti;
+	int fd, ret;
+
+	fd = open(tty, O_RDWR | O_NOCTTY);
+	if (fd < 0)
+		return 2;
+
+	tcgetattr(fd, &ti);
+	cfmakeraw(&ti);
+	tcsetattr(fd, TCSANOW, &ti);
+
+	memset(&rtk_h5, 0, sizeof(rtk_h5));
+	rtk_h5.link_estab_state = H5_PATCH;
+	rtk_h5.tx_win = tx_win;
+	memset(&rtk_patch, 0, sizeof(rtk_patch));
+	rtk_patch.nTotal = TEST_FRAGS - 1;
+	rtk_patch.nRxIndex = -1;
+
+	if (proto == HCI_UART_H4)
+		ret = hci_download_patch_h4(fd, frags, TEST_FRAGS);
+	else
+		ret = hci_download_patch(fd, frags, TEST_FRAGS, &ti);
+
+	if (ret == 0 && proto == HCI_UART_3WIRE &&
+				rtk_h5.link_estab_state != H5_ACTIVE)
+		ret = -1;
+
+	/* let the controller drain the last ack before the pty goes away */
+	usleep(50000);
+	close(fd);
+
+	return ret < 0 ? 1 : 0;
+}
+
+static int run_test(const char *name, int proto, int ncmd, int tx_win)
+{
+	struct controller c;
+	struct pollfd pfd;
+	struct termios ti;
+	long long start, elapsed;
+	int master, slave, status, n, window;
+	pid_t pid;
+
+	if (openpty(&master, &slave, NULL, NULL, NULL) < 0) {
+		perror("openpty");
+		return 1;
+	}
+	tcgetattr(master, &ti);
+	cfmakeraw(&ti);
+	tcsetattr(master, TCSANOW, &ti);
+	tcsetattr(slave, TCSANOW, &ti);
+
+	memset(&c, 0, sizeof(c));
+	c.fd = master;
+	c.proto = proto;
+	c.ncmd = ncmd;
+
+	start = now_ms();
+	pid = fork();
+	if (pid == 0) {
+		close(master);
+		_exit(run_host(proto, ttyname(slave), tx_win));
+	}
+
+	pfd.fd = master;
+	pfd.events = POLLIN;
+
+	while (waitpid(pid, &status, WNOHANG) == 0) {
+		if (now_ms() - start > TEST_TIMEOUT_MS) {
+			printf("timed out\n");
+			kill(pid, SIGKILL);
+			waitpid(pid, &status, 0);
+			c.errors++;
+			break;
+		}
+
+		if (poll(&pfd, 1, 1) > 0) {
+			n = read(master, c.rx + c.rxlen, sizeof(c.rx) - c.rxlen);
+			if (n > 0) {
+				c.rxlen += n;
+				if (proto == HCI_UART_H4)
+					parse_h4(&c);
+				else
+					parse_h5(&c);
+			}
+		}
+
+		send_due(&c);
+	}
+	elapsed = now_ms() - start;
+
+	close(slave);
+	close(master);
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		printf("host download failed\n");
+		c.errors++;
+	}
+
+	if (c.expect != TEST_FRAGS) {
+		printf("got %d of %d fragments\n", c.expect, TEST_FRAGS);
+		c.errors++;
+	}
+
+	/* the host may fill the window it was granted, never more */
+	window = ncmd ? ncmd : 1;
+	if (proto == HCI_UART_3WIRE)
+		window = MIN(window, tx_win);
+	if (c.max_outstanding > window) {
+		printf("%d fragments outstanding, window %d\n", c.max_outstanding, window);
+		c.errors++;
+	}
+
+	printf("%-24s %s  (%d fragments, max %d outstanding, %lld ms)\n", name,
+			c.errors ? "FAIL" : "pass", c.expect, c.max_outstanding, elapsed);
+
+	return c.errors ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int failed = 0;
+
+	signal(SIGPIPE, SIG_IGN);
+	make_frags();
+
+	failed += run_test("h4 ncmd 1", HCI_UART_H4, 1, 0);
+	failed += run_test("h4 ncmd 4", HCI_UART_H4, 4, 0);
+	failed += run_test("h4 ncmd 0", HCI_UART_H4, 0, 0);
+	failed += run_test("h5 ncmd 1", HCI_UART_3WIRE, 1, 4);
+	failed += run_test("h5 ncmd 4 window 4", HCI_UART_3WIRE, 4, 4);
+	failed += run_test("h5 ncmd 4 window 2", HCI_UART_3WIRE, 4, 2);
+	failed += run_test("h5 ncmd 0", HCI_UART_3WIRE, 0, 4);
+
+	return failed ? 1 : 0;
+}
@@ -1722,6 +1722,25 @@ void rtb_read_local_version(int dd)
 	return;
 }
 
+static struct timespec rtb_init_ts;
+static struct timespec rtb_phase_ts;
+
+static long rtb_elapsed_ms(struct timespec *from)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - from->tv_sec) * 1000 +
+	       (now.tv_nsec - from->tv_nsec) / 1000000;
+}
+
+/* Report the time spent since the previous init phase finished */
+static void rtb_phase_done(const char *phase)
+{
+	RS_INFO("Init phase %s: %ld ms", phase, rtb_elapsed_ms(&rtb_phase_ts));
+	clock_gettime(CLOCK_MONOTONIC, &rtb_phase_ts);
+}
+
 /*
  * Config Realtek Bluetooth.
  * Config parameters are got from Realtek Config file and FW.
@@ -1732,6 +1751,7 @@ void rtb_read_local_version(int dd)
 static int rtb_config(int fd, int proto, int speed, struct termios *ti)
 {
 	int final_speed = 0;
+	int cached = 0;
 	int ret = 0;
 
 	rtb_cfg.proto = proto;
@@ -1828,6 +1848,14 @@ static int rtb_config(int fd, int proto, int speed, struct termios *ti)
 		return -1;
 	}
 
+	rtb_phase_done("version");
+
+	rtb_cfg.total_buf = rtb_load_cached_patch(&rtb_cfg, &rtb_cfg.total_len);
+	if (rtb_cfg.total_buf) {
+		cached = 1;
+		goto fwc_ready;
+	}
+
 	rtb_cfg.config_buf = rtb_read_config(&rtb_cfg, &rtb_cfg.config_len);
 	if (!rtb_cfg.config_buf) {
 		RS_ERR("Read Config file error, use eFuse settings");
@@ -1867,11 +1895,20 @@ static int rtb_config(int fd, int proto, int speed, struct termios *ti)
 		}
 	}
 
+fwc_ready:
+	rtb_phase_done("fwc load");
+
 	if (rtb_cfg.total_len > RTB_PATCH_LENGTH_MAX) {
 		RS_ERR("Total length of fwc is larger than allowed");
 		goto buf_free;
 	}
 
+	/* Only cache a patch that will be downloaded, and before the baud
+	 * handling below fills in vendor_baud from the port speed */
+	if (!cached)
+		rtb_save_cached_patch(&rtb_cfg, rtb_cfg.total_buf,
+				      rtb_cfg.total_len);
+
 	RS_INFO("Total len %d for fwc", rtb_cfg.total_len);
 
 	/* rtl8723ds h4 */
@@ -1929,6 +1966,8 @@ change_baud:
 	}
 
 start_download:
+	rtb_phase_done("baudrate");
+
 	/* For 8761B Test chip, no patch to download */
 	if (rtb_cfg.chip_type == CHIP_8761BTC)
 		goto done;
@@ -1939,7 +1978,8 @@ start_download:
 
 		ret = rtb_download_fwc(fd, rtb_cfg.total_buf, rtb_cfg.total_len,
 				       proto, ti);
-		free(rtb_cfg.total_buf);
+		rtb_put_final_patch(rtb_cfg.total_buf);
+		rtb_phase_done("download");
 		if (ret < 0)
 			return ret;
 	}
@@ -1950,7 +1990,7 @@ done:
 	return 0;
 
 buf_free:
-	free(rtb_cfg.total_buf);
+	rtb_put_final_patch(rtb_cfg.total_buf);
 	return -1;
 }
 
@@ -1961,6 +2001,9 @@ int rtb_init(int fd, int proto, int speed, struct termios *ti)
 
 	RS_INFO("Realtek hciattach version %s \n", RTK_VERSION);
 
+	clock_gettime(CLOCK_MONOTONIC, &rtb_init_ts);
+	rtb_phase_ts = rtb_init_ts;
+
 	memset(&rtb_cfg, 0, sizeof(rtb_cfg));
 	rtb_cfg.serial_fd = fd;
 	rtb_cfg.dl_fw_flag = 1;
@@ -2001,6 +2044,7 @@ int rtb_init(int fd, int proto, int speed, struct termios *ti)
 	if (proto == HCI_UART_3WIRE) {
 		if (rtb_init_h5(fd, ti) < 0)
 			return -1;;
+		rtb_phase_done("h5 link");
 	}
 
 	result = rtb_config(fd, proto, speed, ti);
@@ -2010,6 +2054,9 @@ int rtb_init(int fd, int proto, int speed, struct termios *ti)
 	close(rtb_cfg.timerfd);
 	rtb_cfg.timerfd = -1;
 
+	RS_INFO("Init %s in %ld ms", result < 0 ? "failed" : "done",
+		rtb_elapsed_ms(&rtb_init_ts));
+
 	return result;
 }
 
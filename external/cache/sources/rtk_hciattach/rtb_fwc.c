@@ -18,6 +18,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <unistd.h>
@@ -34,6 +35,7 @@
 
 #define FIRMWARE_DIRECTORY  "/lib/firmware/rtlbt/"
 #define BT_CONFIG_DIRECTORY "/lib/firmware/rtlbt/"
+#define FWC_CACHE_DIRECTORY "/var/cache/rtlbt/"
 
 #ifdef USE_CUSTOMER_ADDRESS
 #define BT_ADDR_FILE        "/opt/bdaddr"
@@ -1231,3 +1233,336 @@ err:
 	return NULL;
 }
 
+
+/*
+ * Cache of the final patch.
+ *
+ * The patch extracted from the firmware plus the merged Config is saved
+ * to FWC_CACHE_DIRECTORY after a successful parse. On the next attach
+ * it is mapped directly when the chip identity and all source files
+ * still match, so the firmware/config parsing and merging is skipped.
+ */
+#define FWC_CACHE_VERSION	1
+
+enum {
+	FWC_SRC_FW,
+	FWC_SRC_CONFIG,
+	FWC_SRC_EXTRA,
+#ifdef USE_CUSTOMER_ADDRESS
+	FWC_SRC_BDADDR,
+#endif
+	FWC_SRC_NUM,
+};
+
+struct fwc_cache_src {
+	uint64_t size;		/* UINT64_MAX if the file does not exist */
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint64_t hash;
+};
+
+struct fwc_cache_hdr {
+	uint8_t magic[8];
+	uint32_t version;
+	uint32_t total_len;
+	uint64_t total_hash;
+	uint16_t lmp_subver;
+	uint16_t hci_rev;
+	uint8_t hci_ver;
+	uint8_t eversion;
+	uint8_t chip_type;
+	uint8_t proto;
+	uint32_t vendor_baud;
+	uint8_t uart_flow_ctrl;
+	uint8_t parenb;
+	uint8_t pareven;
+	uint8_t reserved;
+	struct fwc_cache_src src[FWC_SRC_NUM];
+};
+
+static const uint8_t fwc_cache_magic[8] = {
+	'r', 't', 'b', 'f', 'w', 'c', 0, 0
+};
+
+static uint8_t *fwc_cache_map;
+static size_t fwc_cache_map_len;
+
+static uint64_t fwc_hash(const uint8_t *p, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	while (len--) {
+		h ^= *p++;
+		h *= 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+static void fwc_src_path(struct rtb_struct *btrtl, int i, char *path)
+{
+	switch (i) {
+	case FWC_SRC_FW:
+		snprintf(path, PATH_MAX, "%s%s", FIRMWARE_DIRECTORY,
+			 btrtl->patch_ent->patch_file);
+		break;
+	case FWC_SRC_CONFIG:
+		snprintf(path, PATH_MAX, "%s%s", BT_CONFIG_DIRECTORY,
+			 btrtl->patch_ent->config_file);
+		break;
+	case FWC_SRC_EXTRA:
+		snprintf(path, PATH_MAX, "%s", EXTRA_CONFIG_FILE);
+		break;
+#ifdef USE_CUSTOMER_ADDRESS
+	case FWC_SRC_BDADDR:
+		snprintf(path, PATH_MAX, "%s", BT_ADDR_FILE);
+		break;
+#endif
+	}
+}
+
+static int fwc_hash_file(const char *path, size_t size, uint64_t *hash)
+{
+	uint8_t *p;
+	int fd;
+
+	if (!size) {
+		*hash = fwc_hash(NULL, 0);
+		return 0;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return -1;
+
+	*hash = fwc_hash(p, size);
+	munmap(p, size);
+
+	return 0;
+}
+
+static int fwc_src_fill(const char *path, struct fwc_cache_src *src)
+{
+	struct stat st;
+
+	memset(src, 0, sizeof(*src));
+	if (stat(path, &st) < 0) {
+		src->size = UINT64_MAX;
+		return 0;
+	}
+
+	src->size = st.st_size;
+	src->mtime_sec = st.st_mtim.tv_sec;
+	src->mtime_nsec = st.st_mtim.tv_nsec;
+
+	return fwc_hash_file(path, st.st_size, &src->hash);
+}
+
+/* Only hash the file if its size or mtime differs from the cached one */
+static int fwc_src_match(const char *path, const struct fwc_cache_src *src)
+{
+	struct stat st;
+	uint64_t hash;
+
+	if (stat(path, &st) < 0)
+		return src->size == UINT64_MAX;
+
+	if ((uint64_t)st.st_size != src->size)
+		return 0;
+
+	if (st.st_mtim.tv_sec == src->mtime_sec &&
+	    st.st_mtim.tv_nsec == src->mtime_nsec)
+		return 1;
+
+	if (fwc_hash_file(path, st.st_size, &hash) < 0)
+		return 0;
+
+	return hash == src->hash;
+}
+
+static void fwc_cache_path(struct rtb_struct *btrtl, char *path)
+{
+	snprintf(path, PATH_MAX, "%s%s_%s.fwc", FWC_CACHE_DIRECTORY,
+		 btrtl->patch_ent->patch_file,
+		 btrtl->proto == HCI_UART_3WIRE ? "h5" : "h4");
+}
+
+/*
+ * Map the cached final patch.
+ * Returns NULL if there is no valid cache for the chip and source files.
+ */
+uint8_t *rtb_load_cached_patch(struct rtb_struct *btrtl, int *rlen)
+{
+	char path[PATH_MAX];
+	struct fwc_cache_hdr *hdr;
+	struct stat st;
+	uint8_t *map;
+	int fd;
+	int i;
+
+	if (!btrtl || !btrtl->patch_ent || !rlen)
+		return NULL;
+
+	fwc_cache_path(btrtl, path);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0 || st.st_size <= (off_t)sizeof(*hdr)) {
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	hdr = (struct fwc_cache_hdr *)map;
+	if (memcmp(hdr->magic, fwc_cache_magic, sizeof(hdr->magic)) ||
+	    hdr->version != FWC_CACHE_VERSION ||
+	    hdr->total_len + sizeof(*hdr) != (size_t)st.st_size) {
+		RS_INFO("Ignore invalid fwc cache %s", path);
+		goto fail;
+	}
+
+	if (hdr->proto != btrtl->proto ||
+	    hdr->lmp_subver != btrtl->lmp_subver ||
+	    hdr->hci_rev != btrtl->hci_rev ||
+	    hdr->hci_ver != btrtl->hci_ver ||
+	    hdr->eversion != btrtl->eversion ||
+	    hdr->chip_type != btrtl->chip_type) {
+		RS_INFO("fwc cache %s is for another chip", path);
+		goto fail;
+	}
+
+	for (i = 0; i < FWC_SRC_NUM; i++) {
+		char src[PATH_MAX];
+
+		fwc_src_path(btrtl, i, src);
+		if (!fwc_src_match(src, &hdr->src[i])) {
+			RS_INFO("fwc cache is stale, %s changed", src);
+			goto fail;
+		}
+	}
+
+	if (fwc_hash(map + sizeof(*hdr), hdr->total_len) != hdr->total_hash) {
+		RS_ERR("fwc cache %s is corrupted", path);
+		goto fail;
+	}
+
+	btrtl->vendor_baud = hdr->vendor_baud;
+	btrtl->uart_flow_ctrl = hdr->uart_flow_ctrl;
+	btrtl->parenb = hdr->parenb;
+	btrtl->pareven = hdr->pareven;
+	btrtl->dl_fw_flag = 1;
+
+	RS_INFO("Use cached fwc %s, len %u", path, hdr->total_len);
+	RS_INFO("Vendor baud from cache: %08x", btrtl->vendor_baud);
+
+	fwc_cache_map = map;
+	fwc_cache_map_len = st.st_size;
+	*rlen = hdr->total_len;
+
+	return map + sizeof(*hdr);
+
+fail:
+	munmap(map, st.st_size);
+	return NULL;
+}
+
+/*
+ * Save the final patch built from the firmware and Config files.
+ * Failures are not fatal, the next attach just parses the files again.
+ */
+void rtb_save_cached_patch(struct rtb_struct *btrtl, uint8_t *buf, int len)
+{
+	char path[PATH_MAX];
+	char tmp[PATH_MAX + 4];
+	struct fwc_cache_hdr hdr;
+	int fd;
+	int i;
+
+	if (!btrtl || !btrtl->patch_ent || !buf || len <= 0)
+		return;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, fwc_cache_magic, sizeof(hdr.magic));
+	hdr.version = FWC_CACHE_VERSION;
+	hdr.total_len = len;
+	hdr.total_hash = fwc_hash(buf, len);
+	hdr.lmp_subver = btrtl->lmp_subver;
+	hdr.hci_rev = btrtl->hci_rev;
+	hdr.hci_ver = btrtl->hci_ver;
+	hdr.eversion = btrtl->eversion;
+	hdr.chip_type = btrtl->chip_type;
+	hdr.proto = btrtl->proto;
+	hdr.vendor_baud = btrtl->vendor_baud;
+	hdr.uart_flow_ctrl = btrtl->uart_flow_ctrl;
+	hdr.parenb = btrtl->parenb;
+	hdr.pareven = btrtl->pareven;
+
+	for (i = 0; i < FWC_SRC_NUM; i++) {
+		char src[PATH_MAX];
+
+		fwc_src_path(btrtl, i, src);
+		if (fwc_src_fill(src, &hdr.src[i]) < 0) {
+			RS_WARN("Can't hash %s, fwc not cached", src);
+			return;
+		}
+	}
+
+	if (mkdir(FWC_CACHE_DIRECTORY, 0755) < 0 && errno != EEXIST) {
+		RS_WARN("Can't create %s, %s", FWC_CACHE_DIRECTORY,
+			strerror(errno));
+		return;
+	}
+
+	fwc_cache_path(btrtl, path);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		RS_WARN("Can't create %s, %s", tmp, strerror(errno));
+		return;
+	}
+
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	    write(fd, buf, len) != len || fsync(fd) < 0) {
+		RS_WARN("Can't write %s, %s", tmp, strerror(errno));
+		close(fd);
+		unlink(tmp);
+		return;
+	}
+	close(fd);
+
+	if (rename(tmp, path) < 0) {
+		RS_WARN("Can't rename %s, %s", tmp, strerror(errno));
+		unlink(tmp);
+		return;
+	}
+
+	RS_INFO("Saved fwc cache %s", path);
+}
+
+/* Release the final patch from either rtb_get_final_patch() or the cache */
+void rtb_put_final_patch(uint8_t *buf)
+{
+	if (!buf)
+		return;
+
+	if (fwc_cache_map &&
+	    buf == fwc_cache_map + sizeof(struct fwc_cache_hdr)) {
+		munmap(fwc_cache_map, fwc_cache_map_len);
+		fwc_cache_map = NULL;
+		fwc_cache_map_len = 0;
+		return;
+	}
+
+	free(buf);
+}
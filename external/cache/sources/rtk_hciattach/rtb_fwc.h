@@ -73,3 +73,6 @@ struct patch_info *get_patch_entry(struct rtb_struct *btrtl);
 uint8_t *rtb_read_config(struct rtb_struct *btrtl, int *cfg_len);
 uint8_t *rtb_read_firmware(struct rtb_struct *btrtl, int *fw_len);
 uint8_t *rtb_get_final_patch(int fd, int proto, int *rlen);
+uint8_t *rtb_load_cached_patch(struct rtb_struct *btrtl, int *rlen);
+void rtb_save_cached_patch(struct rtb_struct *btrtl, uint8_t *buf, int len);
+void rtb_put_final_patch(uint8_t *buf);
@@ -195,12 +195,73 @@ int pcm_mmap_begin(struct pcm *pcm, void **areas, unsigned int *offset,
                    unsigned int *frames);
 int pcm_mmap_commit(struct pcm *pcm, unsigned int offset, unsigned int frames);
 
+/* Zero-copy streaming on a PCM_MMAP stream.
+ * pcm_mmap_stream_begin() waits up to timeout ms until a period (or
+ * *frames if smaller) can be written (playback) or read (capture) and
+ * points data at the DMA buffer. *frames is set to the number of
+ * contiguous frames that can be used in place, 0 on timeout. They are
+ * handed to the hardware with pcm_mmap_stream_commit(), which also starts
+ * playback once the start threshold is reached. Xruns are counted and the
+ * stream restarted, unless PCM_NORESTART is set (-EPIPE is returned).
+ */
+int pcm_mmap_stream_begin(struct pcm *pcm, void **data, unsigned int *frames,
+                          int timeout);
+int pcm_mmap_stream_commit(struct pcm *pcm, unsigned int frames);
+
+/* Returns the number of xruns since the stream was opened */
+int pcm_get_xruns(struct pcm *pcm);
+
+/* Wait until all pending playback frames have been played */
+int pcm_drain(struct pcm *pcm);
+
+/* Returns the latency of a running stream in microseconds, -1 if unknown.
+ * For an output stream this is the time left to play the queued frames,
+ * for an input stream the age of the oldest frame not yet read.
+ */
+int pcm_get_latency(struct pcm *pcm);
+
+/* Collects pcm_get_latency() samples. Start from a zeroed struct;
+ * pcm_latency_percentile() returns the pct (0 to 100) percentile.
+ */
+struct pcm_latency {
+    unsigned int *us;
+    unsigned int count;
+    unsigned int size;
+    int sorted;
+};
+
+void pcm_latency_add(struct pcm_latency *lat, struct pcm *pcm);
+unsigned int pcm_latency_percentile(struct pcm_latency *lat, unsigned int pct);
+void pcm_latency_free(struct pcm_latency *lat);
+
+/* Lock-free single producer / single consumer byte ring, e.g. to feed
+ * pcm_mmap_stream_begin() from a decoder thread. The size is rounded up
+ * to a power of two. The *_begin() calls return the number of contiguous
+ * bytes available at *data, which are released with *_commit().
+ */
+struct pcm_ring;
+
+struct pcm_ring *pcm_ring_create(unsigned int size);
+void pcm_ring_free(struct pcm_ring *ring);
+unsigned int pcm_ring_avail(struct pcm_ring *ring);
+unsigned int pcm_ring_space(struct pcm_ring *ring);
+unsigned int pcm_ring_write_begin(struct pcm_ring *ring, void **data);
+void pcm_ring_write_commit(struct pcm_ring *ring, unsigned int bytes);
+unsigned int pcm_ring_read_begin(struct pcm_ring *ring, void **data);
+void pcm_ring_read_commit(struct pcm_ring *ring, unsigned int bytes);
+unsigned int pcm_ring_write(struct pcm_ring *ring, const void *data,
+                            unsigned int bytes);
+unsigned int pcm_ring_read(struct pcm_ring *ring, void *data,
+                           unsigned int bytes);
+
 int pcm_resume(struct pcm *pcm);
 /* Prepare the PCM substream to be triggerable */
 int pcm_prepare(struct pcm *pcm);
 /* Start and stop a PCM channel that doesn't transfer data */
 int pcm_start(struct pcm *pcm);
 int pcm_stop(struct pcm *pcm);
+/* Returns the PCM_STATE_* of the stream, or a negative error */
+int pcm_state(struct pcm *pcm);
 
 /* Interrupt driven API */
 int pcm_wait(struct pcm *pcm, int timeout);
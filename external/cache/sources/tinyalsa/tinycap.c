@@ -32,6 +32,10 @@
 #include <stdint.h>
 #include <signal.h>
 #include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
 
 #define ID_RIFF 0x46464952
 #define ID_WAVE 0x45564157
@@ -57,13 +61,18 @@ struct wav_header {
 };
 
 int loop_seconds = 0;
-int capturing = 1;
+volatile sig_atomic_t capturing = 1;
 int prinfo = 1;
+int zero_copy = 0;
 
 unsigned int capture_sample(FILE *file, unsigned int card, unsigned int device,
                             unsigned int channels, unsigned int rate,
                             enum pcm_format format, unsigned int period_size,
                             unsigned int period_count);
+unsigned int capture_sample_mmap(FILE *file, unsigned int card, unsigned int device,
+                                 unsigned int channels, unsigned int rate,
+                                 enum pcm_format format, unsigned int period_size,
+                                 unsigned int period_count);
 
 void sigint_handler(int sig)
 {
@@ -87,8 +96,10 @@ int main(int argc, char **argv)
 
     if (argc < 2) {
         fprintf(stderr, "Usage: %s {file.wav | --} [-D card] [-d device] [-c channels] "
-                "[-t seconds] [-r rate] [-b bits] [-p period_size] [-n n_periods]\n\n"
-                "Use -- for filename to send raw PCM to stdout\n", argv[0]);
+                "[-t seconds] [-r rate] [-b bits] [-p period_size] [-n n_periods] [-z]\n\n"
+                "Use -- for filename to send raw PCM to stdout\n"
+                "Use -z to stream zero-copy through mmap and report xruns and latency\n",
+                argv[0]);
         return 1;
     }
 
@@ -139,6 +150,8 @@ int main(int argc, char **argv)
             argv++;
             if (*argv)
                 loop_seconds = atoi(*argv);
+        } else if (strcmp(*argv, "-z") == 0) {
+            zero_copy = 1;
         }
         if (*argv)
             argv++;
@@ -180,9 +193,14 @@ int main(int argc, char **argv)
 
     /* install signal handler and begin capturing */
     signal(SIGINT, sigint_handler);
-    frames = capture_sample(file, card, device, header.num_channels,
-                            header.sample_rate, format,
-                            period_size, period_count);
+    if (zero_copy)
+        frames = capture_sample_mmap(file, card, device, header.num_channels,
+                                     header.sample_rate, format,
+                                     period_size, period_count);
+    else
+        frames = capture_sample(file, card, device, header.num_channels,
+                                header.sample_rate, format,
+                                period_size, period_count);
     if (prinfo) {
         printf("Captured %d frames\n", frames);
     }
@@ -270,3 +288,142 @@ unsigned int capture_sample(FILE *file, unsigned int card, unsigned int device,
     return frames;
 }
 
+
+struct stream_writer {
+    FILE *file;
+    struct pcm_ring *ring;
+    unsigned long long bytes;
+    int done;
+    int error;
+};
+
+/* Writer thread: store captured data straight from the ring */
+static void *write_stream(void *arg)
+{
+    struct stream_writer *w = arg;
+    unsigned int n;
+    void *data;
+    int done;
+
+    for (;;) {
+        done = __atomic_load_n(&w->done, __ATOMIC_ACQUIRE);
+        n = pcm_ring_read_begin(w->ring, &data);
+        if (!n) {
+            if (done)
+                break;
+            usleep(1000);
+            continue;
+        }
+
+        if (fwrite(data, 1, n, w->file) != n) {
+            __atomic_store_n(&w->error, 1, __ATOMIC_RELEASE);
+            break;
+        }
+        pcm_ring_read_commit(w->ring, n);
+        w->bytes += n;
+    }
+
+    return NULL;
+}
+
+unsigned int capture_sample_mmap(FILE *file, unsigned int card, unsigned int device,
+                                 unsigned int channels, unsigned int rate,
+                                 enum pcm_format format, unsigned int period_size,
+                                 unsigned int period_count)
+{
+    struct pcm_config config;
+    struct stream_writer writer;
+    struct pcm_latency lat;
+    struct pcm *pcm;
+    pthread_t thread;
+    struct timeval tv;
+    unsigned int frames, bytes, frame_bytes, dropped = 0;
+    long time_start;
+    void *data;
+    int err;
+
+    memset(&config, 0, sizeof(config));
+    config.channels = channels;
+    config.rate = rate;
+    config.period_size = period_size;
+    config.period_count = period_count;
+    config.format = format;
+
+    pcm = pcm_open(card, device, PCM_IN | PCM_MMAP | PCM_MONOTONIC, &config);
+    if (!pcm || !pcm_is_ready(pcm)) {
+        fprintf(stderr, "Unable to open PCM device (%s)\n",
+                pcm_get_error(pcm));
+        return 0;
+    }
+
+    frame_bytes = pcm_frames_to_bytes(pcm, 1);
+    memset(&writer, 0, sizeof(writer));
+    memset(&lat, 0, sizeof(lat));
+    writer.file = file;
+    writer.ring = pcm_ring_create(pcm_frames_to_bytes(pcm, pcm_get_buffer_size(pcm)) * 4);
+    if (!writer.ring) {
+        fprintf(stderr, "Unable to allocate stream ring\n");
+        pcm_close(pcm);
+        return 0;
+    }
+
+    if (pthread_create(&thread, NULL, write_stream, &writer)) {
+        fprintf(stderr, "Unable to start writer thread\n");
+        pcm_ring_free(writer.ring);
+        pcm_close(pcm);
+        return 0;
+    }
+
+    if (prinfo) {
+        printf("Capturing sample (mmap): %u ch, %u hz, %u bit\n", channels, rate,
+           pcm_format_to_bits(format));
+    }
+
+    gettimeofday(&tv, NULL);
+    time_start = tv.tv_sec;
+
+    while (capturing && !__atomic_load_n(&writer.error, __ATOMIC_ACQUIRE)) {
+        frames = config.period_size;
+        err = pcm_mmap_stream_begin(pcm, &data, &frames, 1000);
+        if (err < 0) {
+            fprintf(stderr, "Error capturing sample (%s)\n", pcm_get_error(pcm));
+            break;
+        }
+        if (!frames)
+            continue;
+
+        pcm_latency_add(&lat, pcm);
+
+        /* never block the capture path, drop if the writer is behind */
+        bytes = frames * frame_bytes;
+        if (pcm_ring_space(writer.ring) >= bytes)
+            pcm_ring_write(writer.ring, data, bytes);
+        else
+            dropped += frames;
+        pcm_mmap_stream_commit(pcm, frames);
+
+        if (loop_seconds) {
+            gettimeofday(&tv, NULL);
+            if (tv.tv_sec - time_start >= loop_seconds)
+                break;
+        }
+    }
+
+    __atomic_store_n(&writer.done, 1, __ATOMIC_RELEASE);
+    pthread_join(thread, NULL);
+
+    fprintf(stderr, "xruns: %d\n", pcm_get_xruns(pcm));
+    if (lat.count)
+        fprintf(stderr, "latency (us): min %u p50 %u p90 %u p99 %u max %u, %u samples\n",
+                pcm_latency_percentile(&lat, 0), pcm_latency_percentile(&lat, 50),
+                pcm_latency_percentile(&lat, 90), pcm_latency_percentile(&lat, 99),
+                pcm_latency_percentile(&lat, 100), lat.count);
+    if (dropped)
+        fprintf(stderr, "dropped %u frames, writer too slow\n", dropped);
+
+    frames = writer.bytes / frame_bytes;
+    pcm_latency_free(&lat);
+    pcm_ring_free(writer.ring);
+    pcm_close(pcm);
+    return frames;
+}
@@ -32,6 +32,8 @@
 #include <stdint.h>
 #include <string.h>
 #include <signal.h>
+#include <pthread.h>
+#include <time.h>
 #include <sys/time.h>
 
 #define ID_RIFF 0x46464952
@@ -59,19 +61,24 @@ struct chunk_fmt {
     uint16_t bits_per_sample;
 };
 
-static int close = 0;
+/* set from the SIGINT handler, read by the reader thread too */
+static volatile sig_atomic_t close = 0;
 static unsigned int loop_num = 1;
 static unsigned int loop_minutes = 0;
+static int zero_copy = 0;
 
 void play_sample(FILE *file, unsigned int card, unsigned int device, unsigned int channels,
                  unsigned int rate, unsigned int bits, unsigned int period_size,
                  unsigned int period_count);
+void play_sample_mmap(FILE *file, unsigned int card, unsigned int device,
+                      unsigned int channels, unsigned int rate, unsigned int bits,
+                      unsigned int period_size, unsigned int period_count);
 
 void stream_close(int sig)
 {
     /* allow the stream to be closed gracefully */
     signal(sig, SIG_IGN);
-    close = 1;
+    __atomic_store_n(&close, 1, __ATOMIC_RELEASE);
 }
 
 int main(int argc, char **argv)
@@ -90,7 +97,9 @@ int main(int argc, char **argv)
     if (argc < 2) {
         fprintf(stderr, "Usage: %s file.wav [-D card] [-d device] "
 		"[-m loop_minutes] [-i loop_num] "
-		"[-p period_size] [-n period_count] \n", argv[0]);
+		"[-p period_size] [-n period_count] [-z]\n"
+		"Use -z to stream zero-copy through mmap and report xruns "
+		"and latency\n", argv[0]);
         return 1;
     }
 
@@ -162,12 +171,19 @@ int main(int argc, char **argv)
             if (*argv)
                 loop_num = atoi(*argv);
         }
+        if (*argv && strcmp(*argv, "-z") == 0)
+            zero_copy = 1;
         if (*argv)
             argv++;
     }
 
-    play_sample(file, card, device, chunk_fmt.num_channels, chunk_fmt.sample_rate,
-                chunk_fmt.bits_per_sample, period_size, period_count);
+    if (zero_copy)
+        play_sample_mmap(file, card, device, chunk_fmt.num_channels,
+                         chunk_fmt.sample_rate, chunk_fmt.bits_per_sample,
+                         period_size, period_count);
+    else
+        play_sample(file, card, device, chunk_fmt.num_channels, chunk_fmt.sample_rate,
+                    chunk_fmt.bits_per_sample, period_size, period_count);
 
     fclose(file);
 
@@ -311,3 +327,171 @@ void play_sample(FILE *file, unsigned int card, unsigned int device, unsigned in
     pcm_close(pcm);
 }
 
+
+/* unistd.h can't be included here, close is taken */
+static void wait_ms(long ms)
+{
+    struct timespec ts = { 0, ms * 1000000 };
+
+    nanosleep(&ts, NULL);
+}
+
+struct stream_reader {
+    FILE *file;
+    long data_start;
+    struct pcm_ring *ring;
+    int done;
+};
+
+/* Decode thread: read the file straight into the ring */
+static void *read_stream(void *arg)
+{
+    struct stream_reader *r = arg;
+    time_t sec_start = time(NULL);
+    int loop_count = 0;
+    unsigned int n;
+    size_t num_read;
+    void *data;
+
+    while (!__atomic_load_n(&close, __ATOMIC_ACQUIRE)) {
+        n = pcm_ring_write_begin(r->ring, &data);
+        if (!n) {
+            wait_ms(1);
+            continue;
+        }
+
+        num_read = fread(data, 1, n, r->file);
+        if (num_read > 0)
+            pcm_ring_write_commit(r->ring, num_read);
+        if (num_read == n)
+            continue;
+
+        if (!feof(r->file))
+            break;
+
+        printf("--> loop_count = %d\n", ++loop_count);
+        if (loop_minutes == 0) {
+            if (loop_count >= (int)loop_num)
+                break;
+        } else if (time(NULL) - sec_start > (time_t)loop_minutes * 60) {
+            break;
+        }
+        clearerr(r->file);
+        fseek(r->file, r->data_start, SEEK_SET);
+    }
+
+    __atomic_store_n(&r->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+void play_sample_mmap(FILE *file, unsigned int card, unsigned int device,
+                      unsigned int channels, unsigned int rate, unsigned int bits,
+                      unsigned int period_size, unsigned int period_count)
+{
+    struct pcm_config config;
+    struct stream_reader reader;
+    struct pcm_latency lat;
+    struct pcm *pcm;
+    pthread_t thread;
+    unsigned int frame_bytes, frames, bytes;
+    unsigned long long queued = 0;
+    void *data;
+    int done, err;
+
+    memset(&config, 0, sizeof(config));
+    config.channels = channels;
+    config.rate = rate;
+    config.period_size = period_size;
+    config.period_count = period_count;
+    if (bits == 32)
+        config.format = PCM_FORMAT_S32_LE;
+    else if (bits == 24)
+        config.format = PCM_FORMAT_S24_LE;
+    else
+        config.format = PCM_FORMAT_S16_LE;
+
+    if (!sample_is_playable(card, device, channels, rate, bits, period_size, period_count))
+        return;
+
+    pcm = pcm_open(card, device, PCM_OUT | PCM_MMAP | PCM_MONOTONIC, &config);
+    if (!pcm || !pcm_is_ready(pcm)) {
+        fprintf(stderr, "Unable to open PCM device %u (%s)\n",
+                device, pcm_get_error(pcm));
+        return;
+    }
+
+    frame_bytes = pcm_frames_to_bytes(pcm, 1);
+    memset(&reader, 0, sizeof(reader));
+    memset(&lat, 0, sizeof(lat));
+    reader.file = file;
+    reader.data_start = ftell(file);
+    reader.ring = pcm_ring_create(pcm_frames_to_bytes(pcm, pcm_get_buffer_size(pcm)) * 4);
+    if (!reader.ring) {
+        fprintf(stderr, "Unable to allocate stream ring\n");
+        pcm_close(pcm);
+        return;
+    }
+
+    printf("Playing sample (mmap): %u ch, %u hz, %u bit\n", channels, rate, bits);
+
+    signal(SIGINT, stream_close);
+
+    if (pthread_create(&thread, NULL, read_stream, &reader)) {
+        fprintf(stderr, "Unable to start reader thread\n");
+        pcm_ring_free(reader.ring);
+        pcm_close(pcm);
+        return;
+    }
+
+    while (!__atomic_load_n(&close, __ATOMIC_ACQUIRE)) {
+        frames = config.period_size;
+        err = pcm_mmap_stream_begin(pcm, &data, &frames, 1000);
+        if (err < 0) {
+            fprintf(stderr, "Error playing sample (%s)\n", pcm_get_error(pcm));
+            break;
+        }
+        if (!frames)
+            continue;
+
+        done = __atomic_load_n(&reader.done, __ATOMIC_ACQUIRE);
+        bytes = pcm_ring_avail(reader.ring);
+        if (bytes > frames * frame_bytes)
+            bytes = frames * frame_bytes;
+        bytes -= bytes % frame_bytes;
+        if (!bytes) {
+            if (done)
+                break;
+            wait_ms(1);
+            continue;
+        }
+
+        pcm_ring_read(reader.ring, data, bytes);
+        if (pcm_mmap_stream_commit(pcm, bytes / frame_bytes) < 0) {
+            fprintf(stderr, "Error playing sample (%s)\n", pcm_get_error(pcm));
+            break;
+        }
+        queued += bytes / frame_bytes;
+        pcm_latency_add(&lat, pcm);
+    }
+
+    if (!__atomic_load_n(&close, __ATOMIC_ACQUIRE)) {
+        /* a file shorter than the start threshold never started playback */
+        if (queued && pcm_state(pcm) != PCM_STATE_RUNNING)
+            pcm_start(pcm);
+        pcm_drain(pcm);
+    }
+
+    __atomic_store_n(&close, 1, __ATOMIC_RELEASE);
+    pthread_join(thread, NULL);
+
+    printf("xruns: %d\n", pcm_get_xruns(pcm));
+    if (lat.count)
+        printf("latency (us): min %u p50 %u p90 %u p99 %u max %u, %u samples\n",
+               pcm_latency_percentile(&lat, 0), pcm_latency_percentile(&lat, 50),
+               pcm_latency_percentile(&lat, 90), pcm_latency_percentile(&lat, 99),
+               pcm_latency_percentile(&lat, 100), lat.count);
+
+    pcm_latency_free(&lat);
+    pcm_ring_free(reader.ring);
+    pcm_close(pcm);
+}
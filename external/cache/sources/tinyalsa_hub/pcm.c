@@ -38,6 +38,7 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <time.h>
 #include <limits.h>
 
 #include <linux/ioctl.h>
@@ -396,17 +397,14 @@ int pcm_write(struct pcm *pcm, const void *data, unsigned int count)
             int prepare_error = pcm_prepare(pcm);
             if (prepare_error)
                 return prepare_error;
-            if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_WRITEI_FRAMES, &x)) {
-		printf("[%s]-->line:%d,errno:%d\n", __func__, __LINE__, errno);
+            if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_WRITEI_FRAMES, &x))
                 return oops(pcm, errno, "cannot write initial data");
-	    }
             pcm->running = 1;
             return 0;
         }
         if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_WRITEI_FRAMES, &x)) {
             pcm->prepared = 0;
             pcm->running = 0;
-		printf("[%s]-->line:%d,errno:%d\n", __func__, __LINE__, errno);
             if (errno == EPIPE) {
                 /* we failed to make our window -- try to restart if we are
                  * allowed to do so.  Otherwise, simply allow the EPIPE error to
@@ -443,7 +441,6 @@ int pcm_read(struct pcm *pcm, void *data, unsigned int count)
         if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_READI_FRAMES, &x)) {
             pcm->prepared = 0;
             pcm->running = 0;
-		printf("[%s]-->line:%d,errno:%d\n", __func__, __LINE__, errno);
             if (errno == EPIPE) {
                     /* we failed to make our window -- try to restart */
                 pcm->underruns++;
@@ -920,7 +917,7 @@ int pcm_wait(struct pcm *pcm, int timeout)
     int err;
 
     pfd.fd = pcm->fd;
-    pfd.events = POLLOUT | POLLERR | POLLNVAL;
+    pfd.events = (pcm->flags & PCM_IN ? POLLIN : POLLOUT) | POLLERR | POLLNVAL;
 
     do {
         /* let's wait for avail or timeout */
@@ -1048,3 +1045,321 @@ int pcm_mmap_read(struct pcm *pcm, void *data, unsigned int count)
 
     return pcm_mmap_transfer(pcm, data, count);
 }
+
+int pcm_get_xruns(struct pcm *pcm)
+{
+    return pcm->underruns;
+}
+
+int pcm_drain(struct pcm *pcm)
+{
+    if (pcm->flags & PCM_IN)
+        return -EINVAL;
+
+    if (!pcm->running)
+        return 0;
+
+    if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_DRAIN) < 0)
+        return oops(pcm, errno, "cannot drain channel");
+
+    pcm->prepared = 0;
+    pcm->running = 0;
+    return 0;
+}
+
+int pcm_get_latency(struct pcm *pcm)
+{
+    struct timespec tstamp, now;
+    unsigned int avail;
+    long long us, age;
+
+    if (pcm_get_htimestamp(pcm, &avail, &tstamp) < 0)
+        return -1;
+
+    clock_gettime((pcm->flags & PCM_MONOTONIC) ? CLOCK_MONOTONIC : CLOCK_REALTIME,
+                  &now);
+    age = (now.tv_sec - tstamp.tv_sec) * 1000000LL +
+          (now.tv_nsec - tstamp.tv_nsec) / 1000;
+
+    /* frames move on at the sample rate since the hardware timestamp */
+    if (pcm->flags & PCM_IN)
+        us = (long long)avail * 1000000 / pcm->config.rate + age;
+    else
+        us = (long long)(pcm->buffer_size - avail) * 1000000 / pcm->config.rate - age;
+
+    if (us < 0)
+        us = 0;
+    else if (us > INT_MAX)
+        us = INT_MAX;
+    return us;
+}
+
+void pcm_latency_add(struct pcm_latency *lat, struct pcm *pcm)
+{
+    unsigned int *us, size;
+    int latency = pcm_get_latency(pcm);
+
+    if (latency < 0)
+        return;
+
+    if (lat->count == lat->size) {
+        size = lat->size ? lat->size * 2 : 1024;
+        us = realloc(lat->us, size * sizeof(*us));
+        if (!us)
+            return;
+        lat->us = us;
+        lat->size = size;
+    }
+    lat->us[lat->count++] = latency;
+    lat->sorted = 0;
+}
+
+static int pcm_latency_cmp(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+unsigned int pcm_latency_percentile(struct pcm_latency *lat, unsigned int pct)
+{
+    unsigned int i;
+
+    if (!lat->count)
+        return 0;
+
+    if (!lat->sorted) {
+        qsort(lat->us, lat->count, sizeof(*lat->us), pcm_latency_cmp);
+        lat->sorted = 1;
+    }
+
+    i = (unsigned long long)lat->count * pct / 100;
+    if (i >= lat->count)
+        i = lat->count - 1;
+    return lat->us[i];
+}
+
+void pcm_latency_free(struct pcm_latency *lat)
+{
+    free(lat->us);
+    lat->us = NULL;
+    lat->count = lat->size = 0;
+}
+
+static int pcm_mmap_stream_xrun(struct pcm *pcm)
+{
+    pcm->prepared = 0;
+    pcm->running = 0;
+    pcm->underruns++;
+
+    if (pcm->flags & PCM_NORESTART)
+        return -EPIPE;
+
+    return pcm_prepare(pcm);
+}
+
+int pcm_mmap_stream_begin(struct pcm *pcm, void **data, unsigned int *frames,
+                          int timeout)
+{
+    unsigned int need, offset, avail_min;
+    void *areas;
+    int avail, err;
+
+    if (!(pcm->flags & PCM_MMAP))
+        return -ENOSYS;
+
+    need = *frames;
+    if (need > pcm->config.period_size)
+        need = pcm->config.period_size;
+    if (!need)
+        need = 1;
+
+    for (;;) {
+        if (!pcm->prepared && pcm_prepare(pcm) < 0)
+            return -errno;
+
+        if ((pcm->flags & PCM_IN) && !pcm->running && pcm_start(pcm) < 0)
+            return -errno;
+
+        avail = pcm_avail_update(pcm);
+        if (pcm->running && pcm->mmap_status->state == PCM_STATE_XRUN) {
+            err = pcm_mmap_stream_xrun(pcm);
+            if (err < 0)
+                return err;
+            continue;
+        }
+
+        /* playback that has not started yet can always fill the buffer */
+        if ((unsigned int)avail >= need || !pcm->running)
+            break;
+
+        avail_min = pcm->mmap_control->avail_min;
+        pcm->mmap_control->avail_min = need;
+        pcm_sync_ptr(pcm, 0);
+
+        if (pcm->flags & PCM_NOIRQ)
+            timeout = (need - avail) / pcm->noirq_frames_per_msec + 1;
+
+        err = pcm_wait(pcm, timeout);
+
+        pcm->mmap_control->avail_min = avail_min;
+        pcm_sync_ptr(pcm, 0);
+
+        if (err == -EPIPE) {
+            err = pcm_mmap_stream_xrun(pcm);
+            if (err < 0)
+                return err;
+            continue;
+        }
+        if (err < 0)
+            return err;
+        if (err == 0 && !(pcm->flags & PCM_NOIRQ)) {
+            *frames = 0;
+            return 0;
+        }
+    }
+
+    pcm_mmap_begin(pcm, &areas, &offset, frames);
+    *data = (char *)areas + pcm_frames_to_bytes(pcm, offset);
+
+    return 0;
+}
+
+int pcm_mmap_stream_commit(struct pcm *pcm, unsigned int frames)
+{
+    unsigned int offset = pcm->mmap_control->appl_ptr % pcm->buffer_size;
+
+    pcm_mmap_commit(pcm, offset, frames);
+
+    /* start the audio once the playback threshold is reached */
+    if (!(pcm->flags & PCM_IN) && !pcm->running &&
+        pcm->buffer_size - pcm_mmap_playback_avail(pcm) >=
+            pcm->config.start_threshold) {
+        if (pcm_start(pcm) < 0)
+            return -errno;
+    }
+
+    return frames;
+}
+
+/* Single producer / single consumer ring. head is only written by the
+ * producer and tail only by the consumer, so no lock is needed; the
+ * counters run freely and are masked with the power of two size. */
+struct pcm_ring {
+    char *buf;
+    unsigned int size;
+    unsigned int head __attribute__((aligned(64)));
+    unsigned int tail __attribute__((aligned(64)));
+};
+
+struct pcm_ring *pcm_ring_create(unsigned int size)
+{
+    struct pcm_ring *ring;
+    unsigned int sz = 1;
+
+    while (sz < size && sz < 0x80000000U)
+        sz <<= 1;
+
+    ring = calloc(1, sizeof(*ring));
+    if (!ring)
+        return NULL;
+
+    ring->buf = malloc(sz);
+    if (!ring->buf) {
+        free(ring);
+        return NULL;
+    }
+    ring->size = sz;
+
+    return ring;
+}
+
+void pcm_ring_free(struct pcm_ring *ring)
+{
+    if (!ring)
+        return;
+
+    free(ring->buf);
+    free(ring);
+}
+
+unsigned int pcm_ring_avail(struct pcm_ring *ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - ring->tail;
+}
+
+unsigned int pcm_ring_space(struct pcm_ring *ring)
+{
+    return ring->size - (ring->head -
+                         __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+}
+
+unsigned int pcm_ring_write_begin(struct pcm_ring *ring, void **data)
+{
+    unsigned int offset = ring->head & (ring->size - 1);
+    unsigned int space = pcm_ring_space(ring);
+
+    *data = ring->buf + offset;
+
+    return space < ring->size - offset ? space : ring->size - offset;
+}
+
+void pcm_ring_write_commit(struct pcm_ring *ring, unsigned int bytes)
+{
+    __atomic_store_n(&ring->head, ring->head + bytes, __ATOMIC_RELEASE);
+}
+
+unsigned int pcm_ring_read_begin(struct pcm_ring *ring, void **data)
+{
+    unsigned int offset = ring->tail & (ring->size - 1);
+    unsigned int avail = pcm_ring_avail(ring);
+
+    *data = ring->buf + offset;
+
+    return avail < ring->size - offset ? avail : ring->size - offset;
+}
+
+void pcm_ring_read_commit(struct pcm_ring *ring, unsigned int bytes)
+{
+    __atomic_store_n(&ring->tail, ring->tail + bytes, __ATOMIC_RELEASE);
+}
+
+unsigned int pcm_ring_write(struct pcm_ring *ring, const void *data,
+                            unsigned int bytes)
+{
+    unsigned int done = 0, n;
+    void *p;
+
+    while (done < bytes) {
+        n = pcm_ring_write_begin(ring, &p);
+        if (!n)
+            break;
+        if (n > bytes - done)
+            n = bytes - done;
+        memcpy(p, (const char *)data + done, n);
+        pcm_ring_write_commit(ring, n);
+        done += n;
+    }
+
+    return done;
+}
+
+unsigned int pcm_ring_read(struct pcm_ring *ring, void *data,
+                           unsigned int bytes)
+{
+    unsigned int done = 0, n;
+    void *p;
+
+    while (done < bytes) {
+        n = pcm_ring_read_begin(ring, &p);
+        if (!n)
+            break;
+        if (n > bytes - done)
+            n = bytes - done;
+        memcpy((char *)data + done, p, n);
+        pcm_ring_read_commit(ring, n);
+        done += n;
+    }
+
+    return done;
+}
@@ -57,7 +57,7 @@ struct wav_header {
 };
 
 int loop_seconds = 0;
-int capturing = 1;
+volatile sig_atomic_t capturing = 1;
 int prinfo = 1;
 
 unsigned int capture_sample(FILE *file, unsigned int card, unsigned int device,
@@ -59,7 +59,7 @@ struct chunk_fmt {
     uint16_t bits_per_sample;
 };
 
-static int close = 0;
+static volatile sig_atomic_t close = 0;
 static unsigned int loop_num = 1;
 static unsigned int loop_minutes = 0;
 
@@ -0,0 +1,107 @@
+/*
+ * Host-side timing harness for the flat ppr kernels in wlc_ppr.c.
+ *
+ * Times the whole-ppr API on an 80MHz ppr against the per-rate callback path,
+ * and ppr_serialize/ppr_deserialize.  Build with and without -DPPR_NO_VEC to
+ * compare; see "make ppr_bench".
+ *
+ * $Id: $
+ */
+
+#include "wlc_ppr.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_ITERS	200000
+
+static void cb_min(void *ctx, uint8 *a, uint8 *b)
+{
+	BCM_REFERENCE(ctx);
+	*a = MIN((int8)*a, (int8)*b);
+}
+
+static void cb_plus_val(void *ctx, uint8 *a, uint8 *b)
+{
+	BCM_REFERENCE(b);
+	if ((int8)*a != (int8)WL_RATE_DISABLED)
+		*a = (int8)*a + *(int8 *)ctx;
+}
+
+static void cb_percentage(void *ctx, uint8 *a, uint8 *b)
+{
+	BCM_REFERENCE(b);
+	if ((int8)*a != (int8)WL_RATE_DISABLED)
+		*a = ((int8)*a * *(uint8 *)ctx) / 100;
+}
+
+/* The per-rate callback path: one indirect call per power */
+static void cb_map(ppr_mapfn_t fn, void *ctx, ppr_t *p1, ppr_t *p2)
+{
+	uint i;
+	uint8 *a = (uint8 *)&p1->ppr_bw;
+	uint8 *b = (uint8 *)&p2->ppr_bw;
+
+	for (i = 0; i < ppr_pwrs_size(p1->ch_bw); i++)
+		fn(ctx, &a[i], &b[i]);
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#define BENCH(name, stmt) do {							\
+		double t0 = now_ns();						\
+		for (iter = 0; iter < BENCH_ITERS; iter++) {			\
+			stmt;							\
+			__asm__ __volatile__("" ::: "memory");			\
+		}								\
+		printf("  %-28s %8.1f ns\n", name, (now_ns() - t0) / BENCH_ITERS); \
+	} while (0)
+
+int
+main(void)
+{
+	ppr_t *p, *q;
+	uint8 ser[1024];
+	uint i, iter, len = 0;
+	int8 val = 1;
+	uint8 pct = 90;
+	volatile int8 sink;
+
+	p = ppr_create(NULL, WL_TX_BW_80);
+	q = ppr_create(NULL, WL_TX_BW_80);
+	srand(1);
+	for (i = 0; i < ppr_pwrs_size(WL_TX_BW_80); i++) {
+		((uint8 *)&p->ppr_bw)[i] = (uint8)(rand() & 0x7f);
+		((uint8 *)&q->ppr_bw)[i] = (uint8)(rand() & 0x7f);
+	}
+
+#if defined(PPR_VEC_SSE2)
+	printf("ppr_bench (SSE2), 80MHz ppr, %u powers:\n", ppr_pwrs_size(WL_TX_BW_80));
+#elif defined(PPR_VEC_NEON)
+	printf("ppr_bench (NEON), 80MHz ppr, %u powers:\n", ppr_pwrs_size(WL_TX_BW_80));
+#else
+	printf("ppr_bench (scalar), 80MHz ppr, %u powers:\n", ppr_pwrs_size(WL_TX_BW_80));
+#endif
+
+	BENCH("callback min", cb_map(cb_min, NULL, p, q));
+	BENCH("ppr_compare_min", ppr_compare_min(p, q));
+	BENCH("callback plus_val", cb_map(cb_plus_val, &val, p, q));
+	BENCH("ppr_plus_cmn_val", ppr_plus_cmn_val(p, val));
+	BENCH("callback percentage", cb_map(cb_percentage, &pct, p, q); ppr_set_cmn_val(p, 40));
+	BENCH("ppr_multiply_percentage", ppr_multiply_percentage(p, pct); ppr_set_cmn_val(p, 40));
+	BENCH("ppr_get_max", sink = ppr_get_max(q));
+	BENCH("ppr_serialize", ppr_serialize(q, ser, sizeof(ser), &len));
+	BENCH("ppr_deserialize", ppr_deserialize(p, ser, len));
+	BCM_REFERENCE(sink);
+
+	ppr_delete(NULL, p);
+	ppr_delete(NULL, q);
+	return 0;
+}
@@ -0,0 +1,301 @@
+/*
+ * Host-side equivalence test for the flat ppr kernels in wlc_ppr.c.
+ *
+ * Every ppr_vec_* kernel and the whole-ppr API built on it is compared with
+ * the per-rate callback path (ppr_mapfn_t over each power).  Build once with
+ * SIMD and once with -DPPR_NO_VEC; both must pass.  See "make ppr_test".
+ *
+ * $Id: $
+ */
+
+#include "wlc_ppr.c"
+
+#include <stdio.h>
+
+static int failures;
+
+#define CHECK(cond, fmt, ...) do {						\
+		if (!(cond) && failures++ < 20)					\
+			printf("FAIL %s:%d: " fmt "\n", __FUNCTION__, __LINE__, __VA_ARGS__); \
+	} while (0)
+
+/* Per-rate reference operations, in ppr_mapfn_t form */
+typedef struct {
+	int8 val;
+	uint8 pct;
+} ref_ctx_t;
+
+static void ref_min(void *ctx, uint8 *a, uint8 *b)
+{
+	BCM_REFERENCE(ctx);
+	*a = MIN((int8)*a, (int8)*b);
+}
+
+static void ref_max(void *ctx, uint8 *a, uint8 *b)
+{
+	BCM_REFERENCE(ctx);
+	*a = MAX((int8)*a, (int8)*b);
+}
+
+static void ref_max_u8(void *ctx, uint8 *a, uint8 *b)
+{
+	BCM_REFERENCE(ctx);
+	*a = MAX(*a, *b);
+}
+
+static void ref_min_val(void *ctx, uint8 *a, uint8 *b)
+{
+	BCM_REFERENCE(b);
+	*a = MIN((int8)*a, ((ref_ctx_t *)ctx)->val);
+}
+
+static void ref_max_val(void *ctx, uint8 *a, uint8 *b)
+{
+	BCM_REFERENCE(b);
+	*a = MAX((int8)*a, ((ref_ctx_t *)ctx)->val);
+}
+
+static void ref_plus_val(void *ctx, uint8 *a, uint8 *b)
+{
+	BCM_REFERENCE(b);
+	if ((int8)*a != (int8)WL_RATE_DISABLED)
+		*a = (int8)*a + ((ref_ctx_t *)ctx)->val;
+}
+
+static void ref_val_minus(void *ctx, uint8 *a, uint8 *b)
+{
+	BCM_REFERENCE(b);
+	if ((int8)*a != (int8)WL_RATE_DISABLED)
+		*a = ((ref_ctx_t *)ctx)->val - (int8)*a;
+}
+
+static void ref_minus_val_sat(void *ctx, uint8 *a, uint8 *b)
+{
+	int8 val = ((ref_ctx_t *)ctx)->val;
+
+	BCM_REFERENCE(b);
+	if ((int8)*a != (int8)WL_RATE_DISABLED)
+		*a = ((int8)*a > val) ? ((int8)*a - val) : 0;
+}
+
+static void ref_percentage(void *ctx, uint8 *a, uint8 *b)
+{
+	BCM_REFERENCE(b);
+	if ((int8)*a != (int8)WL_RATE_DISABLED)
+		*a = ((int8)*a * ((ref_ctx_t *)ctx)->pct) / 100;
+}
+
+/* Apply a reference op to every power of a ppr, one rate at a time */
+static void ref_map(ppr_mapfn_t fn, ref_ctx_t *ctx, ppr_t *p1, ppr_t *p2)
+{
+	uint i;
+	uint8 *a = (uint8 *)&p1->ppr_bw;
+	uint8 *b = (uint8 *)&p2->ppr_bw;
+
+	for (i = 0; i < ppr_pwrs_size(p1->ch_bw); i++)
+		fn(ctx, &a[i], &b[i]);
+}
+
+static uint32 rnd_state = 1;
+
+static uint8 rnd8(void)
+{
+	rnd_state = rnd_state * 1103515245 + 12345;
+	/* bias towards the interesting edges */
+	switch ((rnd_state >> 28) & 7) {
+	case 0: return (uint8)WL_RATE_DISABLED;
+	case 1: return 0x7f;
+	case 2: return 0;
+	default: return (uint8)(rnd_state >> 16);
+	}
+}
+
+static void fill(ppr_t *p)
+{
+	uint i;
+	uint8 *b = (uint8 *)&p->ppr_bw;
+
+	for (i = 0; i < ppr_pwrs_size(p->ch_bw); i++)
+		b[i] = rnd8();
+}
+
+/* Exhaustive: every int8 power against every int8/uint8 operand */
+static void test_kernels_exhaustive(void)
+{
+	int8 d[256], src[256], exp[256];
+	ref_ctx_t ctx;
+	int v, i;
+
+	for (v = 0; v < 256; v++) {
+		ctx.val = (int8)v;
+		ctx.pct = (uint8)v;
+
+#define EXHAUST(call, fn) do {							\
+		for (i = 0; i < 256; i++) {					\
+			d[i] = exp[i] = (int8)i;				\
+			src[i] = (int8)v;					\
+		}							\
+		for (i = 0; i < 256; i++)					\
+			fn(&ctx, (uint8 *)&exp[i], (uint8 *)&src[i]);		\
+		call;								\
+		for (i = 0; i < 256; i++)					\
+			CHECK(d[i] == exp[i], "%s(%d, %d) = %d, expected %d",	\
+			      #fn, (int8)i, v, d[i], exp[i]);			\
+	} while (0)
+
+		EXHAUST(ppr_vec_min(d, src, 256), ref_min);
+		EXHAUST(ppr_vec_max(d, src, 256), ref_max);
+		EXHAUST(ppr_vec_max_u8(d, src, 256), ref_max_u8);
+		EXHAUST(ppr_vec_min_val(d, 256, ctx.val), ref_min_val);
+		EXHAUST(ppr_vec_max_val(d, 256, ctx.val), ref_max_val);
+		EXHAUST(ppr_vec_plus_val(d, 256, ctx.val), ref_plus_val);
+		EXHAUST(ppr_vec_val_minus(d, 256, ctx.val), ref_val_minus);
+		EXHAUST(ppr_vec_minus_val_sat(d, 256, ctx.val), ref_minus_val_sat);
+		EXHAUST(ppr_vec_percentage(d, 256, ctx.pct), ref_percentage);
+#undef EXHAUST
+	}
+}
+
+/* Odd lengths and offsets exercise the scalar tail and unaligned loads */
+static void test_kernels_tails(void)
+{
+	int8 buf[96], exp[96];
+	uint off, n, i;
+	int8 maxval, minval;
+
+	for (off = 0; off < 16; off++) {
+		for (n = 1; n + off <= sizeof(buf); n++) {
+			for (i = 0; i < sizeof(buf); i++)
+				buf[i] = exp[i] = (int8)rnd8();
+
+			ppr_vec_plus_val(&buf[off], n, 3);
+			for (i = off; i < off + n; i++)
+				if (exp[i] != (int8)WL_RATE_DISABLED)
+					exp[i] += 3;
+			CHECK(!memcmp(buf, exp, sizeof(buf)), "plus_val off %u n %u", off, n);
+
+			maxval = minval = buf[off];
+			for (i = off; i < off + n; i++) {
+				maxval = MAX(maxval, buf[i]);
+				minval = MIN(minval, buf[i]);
+			}
+			CHECK(ppr_vec_reduce_max(&buf[off], n) == maxval, "reduce_max off %u n %u",
+			      off, n);
+			CHECK(ppr_vec_reduce_min(&buf[off], n) == minval, "reduce_min off %u n %u",
+			      off, n);
+		}
+	}
+}
+
+/* The whole-ppr API against the callback path, for every bandwidth */
+static void test_ppr_api(void)
+{
+	static const wl_tx_bw_t bws[] = { WL_TX_BW_20, WL_TX_BW_40, WL_TX_BW_80 };
+	ppr_t *p, *q, *in, *exp;
+	ref_ctx_t ctx;
+	uint iter, sz;
+	wl_tx_bw_t bw;
+
+	for (iter = 0; iter < 3000; iter++) {
+		bw = bws[iter % ARRAYSIZE(bws)];
+		sz = ppr_size(bw);
+		p = ppr_create(NULL, bw);
+		q = ppr_create(NULL, bw);
+		in = ppr_create(NULL, bw);
+		exp = ppr_create(NULL, bw);
+		fill(q);
+		ctx.val = (int8)rnd8();
+		ctx.pct = rnd8();
+
+#define API(call, fn) do {							\
+		fill(p);							\
+		memcpy(in, p, sz);						\
+		memcpy(exp, p, sz);						\
+		ref_map(fn, &ctx, exp, q);					\
+		call;								\
+		CHECK(!memcmp(p, exp, sz), "%s bw %d val %d pct %u", #call,	\
+		      bw, ctx.val, ctx.pct);					\
+		if (bw == WL_TX_BW_20) {					\
+			/* a 20MHz ppr is visited exactly once by map_vec_all */ \
+			memcpy(exp, in, sz);					\
+			ppr_map_vec_all(fn, &ctx, exp, q);			\
+			CHECK(!memcmp(p, exp, sz), "map_vec_all %s", #fn);	\
+		}								\
+	} while (0)
+
+		API(ppr_compare_min(p, q), ref_min);
+		API(ppr_compare_max(p, q), ref_max);
+		API(ppr_apply_vector_ceiling(p, q), ref_min);
+		API(ppr_apply_vector_floor(p, q), ref_max_u8);
+		API(ppr_apply_max(p, ctx.val), ref_min_val);
+		API(ppr_apply_min(p, ctx.val), ref_max_val);
+		API(ppr_plus_cmn_val(p, ctx.val), ref_plus_val);
+		API(ppr_cmn_val_minus(p, ctx.val), ref_val_minus);
+		API(ppr_minus_cmn_val(p, ctx.val), ref_minus_val_sat);
+		API(ppr_multiply_percentage(p, ctx.pct), ref_percentage);
+#undef API
+
+		ppr_delete(NULL, p);
+		ppr_delete(NULL, q);
+		ppr_delete(NULL, in);
+		ppr_delete(NULL, exp);
+	}
+}
+
+/* Flat serialization must match the chain-by-chain layout and round-trip */
+static void test_serialize(void)
+{
+	static const wl_tx_bw_t bws[] = { WL_TX_BW_20, WL_TX_BW_40, WL_TX_BW_80 };
+	uint8 ser[1024], exp[1024];
+	uint8 *eptr;
+	ppr_t *p, *q;
+	uint i, len, bands;
+	wl_tx_bw_t bw;
+
+	CHECK(ppr_ser_is_flat(ppr_get_flag()), "flag 0x%x not flat", ppr_get_flag());
+
+	for (i = 0; i < ARRAYSIZE(bws); i++) {
+		bw = bws[i];
+		p = ppr_create(NULL, bw);
+		q = ppr_create(NULL, bw);
+		fill(p);
+
+		memset(ser, 0, sizeof(ser));
+		CHECK(ppr_serialize(p, ser, sizeof(ser), &len) == BCME_OK, "serialize bw %d", bw);
+
+		/* expected bytes, built with the per-chain block copier */
+		memcpy(exp, ser, SER_HDR_LEN);
+		eptr = exp + SER_HDR_LEN;
+		for (bands = 0; bands < ppr_pwrs_size(bw) / sizeof(pprpbw_t); bands++)
+			ppr_serialize_block((const uint8 *)&p->ppr_bw + bands * sizeof(pprpbw_t),
+				&eptr, ppr_get_flag());
+		CHECK(len == (uint)(eptr - exp), "bw %d len %u expected %u", bw, len,
+		      (uint)(eptr - exp));
+		CHECK(!memcmp(ser, exp, len), "bw %d flat layout differs", bw);
+
+		CHECK(ppr_deserialize(q, ser, len) == BCME_OK, "deserialize bw %d", bw);
+		CHECK(!memcmp(p, q, ppr_size(bw)), "bw %d round trip differs", bw);
+
+		ppr_delete(NULL, p);
+		ppr_delete(NULL, q);
+	}
+}
+
+int
+main(void)
+{
+	test_kernels_exhaustive();
+	test_kernels_tails();
+	test_ppr_api();
+	test_serialize();
+
+#if defined(PPR_VEC_SSE2)
+	printf("ppr_test (SSE2): ");
+#elif defined(PPR_VEC_NEON)
+	printf("ppr_test (NEON): ");
+#else
+	printf("ppr_test (scalar): ");
+#endif
+	printf("%s, %d failures\n", failures ? "FAILED" : "ok", failures);
+	return failures ? 1 : 0;
+}
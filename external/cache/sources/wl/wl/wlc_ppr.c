@@ -36,6 +36,19 @@
 #ifndef ASSERT
 #define ASSERT(exp)	do {} while (0)
 #endif
+
+/* Whole-ppr arithmetic uses SIMD where available; never in the driver, which
+ * must not touch the FPU/vector register file.  PPR_NO_VEC forces scalar.
+ */
+#ifndef PPR_NO_VEC
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PPR_VEC_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PPR_VEC_NEON
+#endif
+#endif /* PPR_NO_VEC */
 #endif /* BCMDRIVER */
 
 /* ppr local TXBF_ENAB() macro because wlc->pub struct is not accessible */
@@ -201,6 +214,8 @@ BWL_PRE_PACKED_STRUCT struct ppr {
 /* This marks the end of a packed structure section. */
 #include <packed_section_end.h>
 
+static uint32 ppr_pwrs_size(wl_tx_bw_t bw);
+
 
 /* Returns a flag of ppr conditions (chains, txbf etc.) */
 static uint32 ppr_get_flag(void)
@@ -265,6 +280,24 @@ static uint ppr_ser_size_by_flag(uint32 flag, wl_tx_bw_t bw)
 	return ret;
 }
 
+/* True if a band serialized with this flag is laid out exactly as pprpbw_t,
+ * in which case the bands of a ppr are moved whole instead of chain by chain.
+ */
+static bool ppr_ser_is_flat(uint32 flag)
+{
+	return (ppr_ser_size_per_band(flag) == sizeof(pprpbw_t)) &&
+		(PPR_TXBF_ENAB() || !(flag & PPR_BEAMFORMING));
+}
+
+/* Copy n whole bands.  The constant size lets the compiler use plain vector
+ * moves, a variable length copy of a few hundred bytes is slower here.
+ */
+static void ppr_copy_bands(uint8* dst, const uint8* src, uint n)
+{
+	for (; n; n--, dst += sizeof(pprpbw_t), src += sizeof(pprpbw_t))
+		bcopy(src, dst, sizeof(pprpbw_t));
+}
+
 #define COPY_PPR_TOBUF(x, y) do { bcopy(&pprbuf[x], *buf, y); \
 	*buf += y; ret += y; } while (0);
 
@@ -316,6 +349,11 @@ static uint ppr_serialize_data(const ppr_t *pprptr, uint8* buf, uint32 serflag)
 	header->per_band_size	= HTON16(ppr_ser_size_per_band(serflag));
 
 	buf += sizeof(*header);
+	if (ppr_ser_is_flat(serflag)) {
+		ppr_copy_bands(buf, (const uint8*)&pprptr->ppr_bw,
+			ppr_pwrs_size(pprptr->ch_bw) / sizeof(pprpbw_t));
+		return ret + ppr_pwrs_size(pprptr->ch_bw);
+	}
 	switch (header->bw) {
 	case WL_TX_BW_20:
 		{
@@ -398,6 +436,10 @@ static void
 ppr_deser_cpy(ppr_t* pptr, const uint8* inbuf, uint32 flag, wl_tx_bw_t bw, uint16 per_band_size)
 {
 	pptr->ch_bw = bw;
+	if ((per_band_size == sizeof(pprpbw_t)) && ppr_ser_is_flat(flag)) {
+		ppr_copy_bands((uint8*)&pptr->ppr_bw, inbuf, ppr_pwrs_size(bw) / sizeof(pprpbw_t));
+		return;
+	}
 	switch (bw) {
 	case WL_TX_BW_20:
 		{
@@ -1208,25 +1250,267 @@ int ppr_set_same_vht_mcs(ppr_t* pprptr, wl_tx_bw_t bw, wl_tx_nss_t Nss, wl_tx_mo
 }
 
 
+/*
+ * Flat int8 kernels.  A ppr is one packed block of int8 powers (ppr_bw), so
+ * the whole-set operations below run over it 16 rates at a time with a
+ * scalar loop for the tail.  Each kernel returns the number of rates visited.
+ */
+
+#if defined(PPR_VEC_SSE2) || defined(PPR_VEC_NEON)
+#define PPR_VEC_LEN	16
+
+#if defined(PPR_VEC_SSE2)
+typedef __m128i ppr_vec_t;
+#define PPR_VLOAD(p)		_mm_loadu_si128((const __m128i *)(p))
+#define PPR_VSTORE(p, v)	_mm_storeu_si128((__m128i *)(p), (v))
+#define PPR_VDUP(x)		_mm_set1_epi8((char)(x))
+#define PPR_VADD(a, b)		_mm_add_epi8((a), (b))
+#define PPR_VSUB(a, b)		_mm_sub_epi8((a), (b))
+#define PPR_VAND(a, b)		_mm_and_si128((a), (b))
+#define PPR_VEQ(a, b)		_mm_cmpeq_epi8((a), (b))
+#define PPR_VGT(a, b)		_mm_cmpgt_epi8((a), (b))
+/* m ? a : b, m being a compare result */
+#define PPR_VSEL(m, a, b)	_mm_or_si128(_mm_and_si128((m), (a)), _mm_andnot_si128((m), (b)))
+#define PPR_VMAXU(a, b)		_mm_max_epu8((a), (b))
+
+/* SSE2 has no signed byte min/max; bias to unsigned and back */
+static INLINE ppr_vec_t ppr_vmin(ppr_vec_t a, ppr_vec_t b)
+{
+	const ppr_vec_t bias = _mm_set1_epi8((char)0x80);
+	return _mm_xor_si128(_mm_min_epu8(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias)), bias);
+}
+
+static INLINE ppr_vec_t ppr_vmax(ppr_vec_t a, ppr_vec_t b)
+{
+	const ppr_vec_t bias = _mm_set1_epi8((char)0x80);
+	return _mm_xor_si128(_mm_max_epu8(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias)), bias);
+}
+
+/* (a * pct) / 100 per lane, truncated toward zero and wrapped to int8 as in C.
+ * |a * pct| <= 128 * 255 fits int16; x / 100 == (x * 5243 >> 19) + (x < 0).
+ */
+static INLINE ppr_vec_t ppr_vpct(ppr_vec_t a, uint8 pct)
+{
+	const __m128i sign = _mm_cmpgt_epi8(_mm_setzero_si128(), a);
+	const __m128i mul = _mm_set1_epi16(pct);
+	const __m128i magic = _mm_set1_epi16(5243);
+	const __m128i lo8 = _mm_set1_epi16(0xff);
+	__m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(a, sign), mul);
+	__m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(a, sign), mul);
+
+	lo = _mm_sub_epi16(_mm_srai_epi16(_mm_mulhi_epi16(lo, magic), 3), _mm_srai_epi16(lo, 15));
+	hi = _mm_sub_epi16(_mm_srai_epi16(_mm_mulhi_epi16(hi, magic), 3), _mm_srai_epi16(hi, 15));
+	return _mm_packus_epi16(_mm_and_si128(lo, lo8), _mm_and_si128(hi, lo8));
+}
+#else
+typedef int8x16_t ppr_vec_t;
+#define PPR_VLOAD(p)		vld1q_s8((const int8_t *)(p))
+#define PPR_VSTORE(p, v)	vst1q_s8((int8_t *)(p), (v))
+#define PPR_VDUP(x)		vdupq_n_s8(x)
+#define PPR_VADD(a, b)		vaddq_s8((a), (b))
+#define PPR_VSUB(a, b)		vsubq_s8((a), (b))
+#define PPR_VAND(a, b)		vandq_s8((a), (b))
+#define PPR_VEQ(a, b)		vreinterpretq_s8_u8(vceqq_s8((a), (b)))
+#define PPR_VGT(a, b)		vreinterpretq_s8_u8(vcgtq_s8((a), (b)))
+#define PPR_VSEL(m, a, b)	vbslq_s8(vreinterpretq_u8_s8(m), (a), (b))
+#define PPR_VMAXU(a, b)		vreinterpretq_s8_u8(vmaxq_u8(vreinterpretq_u8_s8(a), \
+					vreinterpretq_u8_s8(b)))
+#define ppr_vmin(a, b)		vminq_s8((a), (b))
+#define ppr_vmax(a, b)		vmaxq_s8((a), (b))
+
+static INLINE int8x8_t ppr_vpct_half(int8x8_t a, uint8 pct)
+{
+	int16x8_t x = vmulq_n_s16(vmovl_s8(a), pct);
+	int32x4_t lo = vmull_n_s16(vget_low_s16(x), 5243);
+	int32x4_t hi = vmull_n_s16(vget_high_s16(x), 5243);
+
+	lo = vsubq_s32(vshrq_n_s32(lo, 19), vshrq_n_s32(lo, 31));
+	hi = vsubq_s32(vshrq_n_s32(hi, 19), vshrq_n_s32(hi, 31));
+	return vmovn_s16(vcombine_s16(vmovn_s32(lo), vmovn_s32(hi)));
+}
+
+/* (a * pct) / 100 per lane, truncated toward zero and wrapped to int8 as in C */
+static INLINE ppr_vec_t ppr_vpct(ppr_vec_t a, uint8 pct)
+{
+	return vcombine_s8(ppr_vpct_half(vget_low_s8(a), pct),
+		ppr_vpct_half(vget_high_s8(a), pct));
+}
+#endif /* PPR_VEC_SSE2 */
+
+/* Run 'vexpr' over whole vectors of d (and s), storing the result into d */
+#define PPR_VEC_LOOP(vexpr) do {					\
+		for (; i + PPR_VEC_LEN <= n; i += PPR_VEC_LEN) {		\
+			ppr_vec_t vd = PPR_VLOAD(&d[i]);			\
+			PPR_VSTORE(&d[i], (vexpr));				\
+		}							\
+	} while (0)
+#define PPR_VEC_LOOP2(vexpr) do {					\
+		for (; i + PPR_VEC_LEN <= n; i += PPR_VEC_LEN) {		\
+			ppr_vec_t vd = PPR_VLOAD(&d[i]);			\
+			ppr_vec_t vs = PPR_VLOAD(&s[i]);			\
+			PPR_VSTORE(&d[i], (vexpr));				\
+		}							\
+	} while (0)
+#else
+#define PPR_VEC_LOOP(vexpr)	do {} while (0)
+#define PPR_VEC_LOOP2(vexpr)	do {} while (0)
+#endif /* PPR_VEC_SSE2 || PPR_VEC_NEON */
+
+/* d[i] = MIN(d[i], val) */
+static uint ppr_vec_min_val(int8* d, uint n, int8 val)
+{
+	uint i = 0;
+	PPR_VEC_LOOP(ppr_vmin(vd, PPR_VDUP(val)));
+	for (; i < n; i++)
+		d[i] = MIN(d[i], val);
+	return n;
+}
+
+/* d[i] = MAX(d[i], val) */
+static uint ppr_vec_max_val(int8* d, uint n, int8 val)
+{
+	uint i = 0;
+	PPR_VEC_LOOP(ppr_vmax(vd, PPR_VDUP(val)));
+	for (; i < n; i++)
+		d[i] = MAX(d[i], val);
+	return n;
+}
+
+/* d[i] = MIN(d[i], s[i]) */
+static uint ppr_vec_min(int8* d, const int8* s, uint n)
+{
+	uint i = 0;
+	PPR_VEC_LOOP2(ppr_vmin(vd, vs));
+	for (; i < n; i++)
+		d[i] = MIN(d[i], s[i]);
+	return n;
+}
+
+/* d[i] = MAX(d[i], s[i]) */
+static uint ppr_vec_max(int8* d, const int8* s, uint n)
+{
+	uint i = 0;
+	PPR_VEC_LOOP2(ppr_vmax(vd, vs));
+	for (; i < n; i++)
+		d[i] = MAX(d[i], s[i]);
+	return n;
+}
+
+/* d[i] = MAX(d[i], s[i]) compared as unsigned, as ppr_apply_vector_floor() always has */
+static uint ppr_vec_max_u8(int8* d, const int8* s, uint n)
+{
+	uint i = 0;
+	PPR_VEC_LOOP2(PPR_VMAXU(vd, vs));
+	for (; i < n; i++)
+		d[i] = MAX((uint8)d[i], (uint8)s[i]);
+	return n;
+}
+
+/* The remaining kernels leave WL_RATE_DISABLED entries untouched */
+
+/* d[i] += val */
+static uint ppr_vec_plus_val(int8* d, uint n, int8 val)
+{
+	uint i = 0;
+	PPR_VEC_LOOP(PPR_VSEL(PPR_VEQ(vd, PPR_VDUP(WL_RATE_DISABLED)), vd,
+		PPR_VADD(vd, PPR_VDUP(val))));
+	for (; i < n; i++)
+		if (d[i] != (int8)WL_RATE_DISABLED)
+			d[i] += val;
+	return n;
+}
+
+/* d[i] = val - d[i] */
+static uint ppr_vec_val_minus(int8* d, uint n, int8 val)
+{
+	uint i = 0;
+	PPR_VEC_LOOP(PPR_VSEL(PPR_VEQ(vd, PPR_VDUP(WL_RATE_DISABLED)), vd,
+		PPR_VSUB(PPR_VDUP(val), vd)));
+	for (; i < n; i++)
+		if (d[i] != (int8)WL_RATE_DISABLED)
+			d[i] = val - d[i];
+	return n;
+}
+
+/* d[i] = d[i] - val, floored at 0 */
+static uint ppr_vec_minus_val_sat(int8* d, uint n, int8 val)
+{
+	uint i = 0;
+	PPR_VEC_LOOP(PPR_VSEL(PPR_VEQ(vd, PPR_VDUP(WL_RATE_DISABLED)), vd,
+		PPR_VAND(PPR_VGT(vd, PPR_VDUP(val)), PPR_VSUB(vd, PPR_VDUP(val)))));
+	for (; i < n; i++)
+		if (d[i] != (int8)WL_RATE_DISABLED)
+			d[i] = (d[i] > val) ? (d[i] - val) : 0;
+	return n;
+}
+
+/* d[i] = d[i] * pct / 100 */
+static uint ppr_vec_percentage(int8* d, uint n, uint8 pct)
+{
+	uint i = 0;
+	PPR_VEC_LOOP(PPR_VSEL(PPR_VEQ(vd, PPR_VDUP(WL_RATE_DISABLED)), vd,
+		ppr_vpct(vd, pct)));
+	for (; i < n; i++)
+		if (d[i] != (int8)WL_RATE_DISABLED)
+			d[i] = (d[i] * pct) / 100;
+	return n;
+}
+
+/* Largest/smallest of n >= 1 powers */
+static int8 ppr_vec_reduce_max(const int8* s, uint n)
+{
+	uint i = 0;
+	int8 maxval = s[0];
+#if defined(PPR_VEC_LEN)
+	if (n >= PPR_VEC_LEN) {
+		int8 lanes[PPR_VEC_LEN];
+		ppr_vec_t acc = PPR_VLOAD(s);
+		for (i = PPR_VEC_LEN; i + PPR_VEC_LEN <= n; i += PPR_VEC_LEN)
+			acc = ppr_vmax(acc, PPR_VLOAD(&s[i]));
+		PPR_VSTORE(lanes, acc);
+		for (maxval = lanes[0], n -= i, s += i, i = 1; i < PPR_VEC_LEN; i++)
+			maxval = MAX(maxval, lanes[i]);
+		i = 0;
+	}
+#endif
+	for (; i < n; i++)
+		maxval = MAX(maxval, s[i]);
+	return maxval;
+}
+
+static int8 ppr_vec_reduce_min(const int8* s, uint n)
+{
+	uint i = 0;
+	int8 minval = s[0];
+#if defined(PPR_VEC_LEN)
+	if (n >= PPR_VEC_LEN) {
+		int8 lanes[PPR_VEC_LEN];
+		ppr_vec_t acc = PPR_VLOAD(s);
+		for (i = PPR_VEC_LEN; i + PPR_VEC_LEN <= n; i += PPR_VEC_LEN)
+			acc = ppr_vmin(acc, PPR_VLOAD(&s[i]));
+		PPR_VSTORE(lanes, acc);
+		for (minval = lanes[0], n -= i, s += i, i = 1; i < PPR_VEC_LEN; i++)
+			minval = MIN(minval, lanes[i]);
+		i = 0;
+	}
+#endif
+	for (; i < n; i++)
+		minval = MIN(minval, s[i]);
+	return minval;
+}
+
+
 /* Helper routines to operate on the entire ppr set */
 
 /* Ensure no rate limit is greater than the cap */
 uint ppr_apply_max(ppr_t* pprptr, int8 maxval)
 {
-	uint i;
-	int8* rptr = (int8*)&pprptr->ppr_bw;
-
-	for (i = 0; i < ppr_pwrs_size(pprptr->ch_bw); i++, rptr++) {
-		*rptr = MIN(*rptr, maxval);
-	}
-	return i;
+	return ppr_vec_min_val((int8*)&pprptr->ppr_bw, ppr_pwrs_size(pprptr->ch_bw), maxval);
 }
 
 #if (PPR_MAX_TX_CHAINS > 1)
 #define APPLY_CONSTRAINT(x, y, max) do {		\
-		ret += (y - x);							\
-		for (i = x; i < y; i++)					\
-			pprbuf[i] = MIN(pprbuf[i], max);	\
+		ret += ppr_vec_min_val(&pprbuf[x], (y - x), max);	\
 	} while (0);
 
 
@@ -1234,7 +1518,6 @@ uint ppr_apply_max(ppr_t* pprptr, int8 maxval)
 static uint ppr_apply_constraint_to_block(int8* pprbuf, int8 constraint)
 {
 	uint ret = 0;
-	uint i = 0;
 	int8 constraint_2chain = constraint - QDB(3);
 #if (PPR_MAX_TX_CHAINS > 2)
 	int8 constraint_3chain = constraint - (QDB(4) + 3); /* - 4.75dBm */
@@ -1309,13 +1592,7 @@ uint ppr_apply_constraint_total_tx(ppr_t* pprptr, int8 constraint)
 /* Ensure no rate limit is lower than the specified minimum */
 uint ppr_apply_min(ppr_t* pprptr, int8 minval)
 {
-	uint i;
-	int8* rptr = (int8*)&pprptr->ppr_bw;
-
-	for (i = 0; i < ppr_pwrs_size(pprptr->ch_bw); i++, rptr++) {
-		*rptr = MAX(*rptr, minval);
-	}
-	return i;
+	return ppr_vec_max_val((int8*)&pprptr->ppr_bw, ppr_pwrs_size(pprptr->ch_bw), minval);
 }
 
 
@@ -1323,13 +1600,10 @@ uint ppr_apply_min(ppr_t* pprptr, int8 minval)
 uint ppr_apply_vector_ceiling(ppr_t* pprptr, const ppr_t* ppr_cap)
 {
 	uint i = 0;
-	int8* rptr = (int8*)&pprptr->ppr_bw;
-	const int8* capptr = (const int8*)&ppr_cap->ppr_bw;
 
 	if (pprptr->ch_bw == ppr_cap->ch_bw) {
-		for (i = 0; i < ppr_pwrs_size(pprptr->ch_bw); i++, rptr++, capptr++) {
-			*rptr = MIN(*rptr, *capptr);
-		}
+		i = ppr_vec_min((int8*)&pprptr->ppr_bw, (const int8*)&ppr_cap->ppr_bw,
+			ppr_pwrs_size(pprptr->ch_bw));
 	}
 	return i;
 }
@@ -1339,13 +1613,10 @@ uint ppr_apply_vector_ceiling(ppr_t* pprptr, const ppr_t* ppr_cap)
 uint ppr_apply_vector_floor(ppr_t* pprptr, const ppr_t* ppr_min)
 {
 	uint i = 0;
-	int8* rptr = (int8*)&pprptr->ppr_bw;
-	const int8* minptr = (const int8*)&ppr_min->ppr_bw;
 
 	if (pprptr->ch_bw == ppr_min->ch_bw) {
-		for (i = 0; i < ppr_pwrs_size(pprptr->ch_bw); i++, rptr++, minptr++) {
-			*rptr = MAX((uint8)*rptr, (uint8)*minptr);
-		}
+		i = ppr_vec_max_u8((int8*)&pprptr->ppr_bw, (const int8*)&ppr_min->ppr_bw,
+			ppr_pwrs_size(pprptr->ch_bw));
 	}
 	return i;
 }
@@ -1354,14 +1625,7 @@ uint ppr_apply_vector_floor(ppr_t* pprptr, const ppr_t* ppr_min)
 /* Get the maximum power in the ppr set */
 int8 ppr_get_max(ppr_t* pprptr)
 {
-	uint i;
-	int8* rptr = (int8*)&pprptr->ppr_bw;
-	int8 maxval = *rptr++;
-
-	for (i = 1; i < ppr_pwrs_size(pprptr->ch_bw); i++, rptr++) {
-		maxval = MAX(maxval, *rptr);
-	}
-	return maxval;
+	return ppr_vec_reduce_max((const int8*)&pprptr->ppr_bw, ppr_pwrs_size(pprptr->ch_bw));
 }
 
 
@@ -1372,14 +1636,15 @@ int8 ppr_get_max(ppr_t* pprptr)
 int8 ppr_get_min(ppr_t* pprptr, int8 floor)
 {
 	uint i;
+	uint pprsize = ppr_pwrs_size(pprptr->ch_bw);
 	int8* rptr = (int8*)&pprptr->ppr_bw;
 	int8 minval = WL_RATE_DISABLED;
 
-	for (i = 0; (i < ppr_pwrs_size(pprptr->ch_bw)) && ((minval == WL_RATE_DISABLED) ||
+	for (i = 0; (i < pprsize) && ((minval == WL_RATE_DISABLED) ||
 		(minval == floor)); i++, rptr++) {
 		minval = *rptr;
 	}
-	for (; i < ppr_pwrs_size(pprptr->ch_bw); i++, rptr++) {
+	for (; i < pprsize; i++, rptr++) {
 		if ((*rptr != WL_RATE_DISABLED) && (*rptr != floor))
 			minval = MIN(minval, *rptr);
 	}
@@ -1390,19 +1655,12 @@ int8 ppr_get_min(ppr_t* pprptr, int8 floor)
 /* Get the maximum power for a given bandwidth in the ppr set */
 int8 ppr_get_max_for_bw(ppr_t* pprptr, wl_tx_bw_t bw)
 {
-	uint i;
 	const pprpbw_t* bw_pwrs;
-	const int8* rptr;
 	int8 maxval;
 
 	bw_pwrs = ppr_get_bw_powers(pprptr, bw);
 	if (bw_pwrs != NULL) {
-		rptr = (const int8*)bw_pwrs;
-		maxval = *rptr++;
-
-		for (i = 1; i < sizeof(*bw_pwrs); i++, rptr++) {
-			maxval = MAX(maxval, *rptr);
-		}
+		maxval = ppr_vec_reduce_max((const int8*)bw_pwrs, sizeof(*bw_pwrs));
 	} else {
 		maxval = WL_RATE_DISABLED;
 	}
@@ -1413,19 +1671,12 @@ int8 ppr_get_max_for_bw(ppr_t* pprptr, wl_tx_bw_t bw)
 /* Get the minimum power for a given bandwidth  in the ppr set */
 int8 ppr_get_min_for_bw(ppr_t* pprptr, wl_tx_bw_t bw)
 {
-	uint i;
 	const pprpbw_t* bw_pwrs;
-	const int8* rptr;
 	int8 minval;
 
 	bw_pwrs = ppr_get_bw_powers(pprptr, bw);
 	if (bw_pwrs != NULL) {
-		rptr = (const int8*)bw_pwrs;
-		minval = *rptr++;
-
-		for (i = 1; i < sizeof(*bw_pwrs); i++, rptr++) {
-			minval = MIN(minval, *rptr);
-		}
+		minval = ppr_vec_reduce_min((const int8*)bw_pwrs, sizeof(*bw_pwrs));
 	} else
 		minval = WL_RATE_DISABLED;
 	return minval;
@@ -1672,14 +1923,7 @@ ppr_copy_struct(ppr_t* pprptr_s, ppr_t* pprptr_d)
 void
 ppr_cmn_val_minus(ppr_t* pprptr, int8 val)
 {
-	uint i;
-	int8* rptr = (int8*)&pprptr->ppr_bw;
-
-	for (i = 0; i < ppr_pwrs_size(pprptr->ch_bw); i++, rptr++) {
-		if (*rptr != (int8)WL_RATE_DISABLED)
-			*rptr = val - *rptr;
-	}
-
+	ppr_vec_val_minus((int8*)&pprptr->ppr_bw, ppr_pwrs_size(pprptr->ch_bw), val);
 }
 
 
@@ -1687,14 +1931,7 @@ ppr_cmn_val_minus(ppr_t* pprptr, int8 val)
 void
 ppr_minus_cmn_val(ppr_t* pprptr, int8 val)
 {
-	uint i;
-	int8* rptr = (int8*)&pprptr->ppr_bw;
-
-	for (i = 0; i < ppr_pwrs_size(pprptr->ch_bw); i++, rptr++) {
-		if (*rptr != (int8)WL_RATE_DISABLED)
-			*rptr = (*rptr > val) ? (*rptr - val) : 0;
-	}
-
+	ppr_vec_minus_val_sat((int8*)&pprptr->ppr_bw, ppr_pwrs_size(pprptr->ch_bw), val);
 }
 
 
@@ -1702,14 +1939,7 @@ ppr_minus_cmn_val(ppr_t* pprptr, int8 val)
 void
 ppr_plus_cmn_val(ppr_t* pprptr, int8 val)
 {
-	uint i;
-	int8* rptr = (int8*)&pprptr->ppr_bw;
-
-	for (i = 0; i < ppr_pwrs_size(pprptr->ch_bw); i++, rptr++) {
-		if (*rptr != (int8)WL_RATE_DISABLED)
-			*rptr += val;
-	}
-
+	ppr_vec_plus_val((int8*)&pprptr->ppr_bw, ppr_pwrs_size(pprptr->ch_bw), val);
 }
 
 
@@ -1717,14 +1947,7 @@ ppr_plus_cmn_val(ppr_t* pprptr, int8 val)
 void
 ppr_multiply_percentage(ppr_t* pprptr, uint8 val)
 {
-	uint i;
-	int8* rptr = (int8*)&pprptr->ppr_bw;
-
-	for (i = 0; i < ppr_pwrs_size(pprptr->ch_bw); i++, rptr++) {
-		if (*rptr != (int8)WL_RATE_DISABLED)
-			*rptr = (*rptr * val) / 100;
-	}
-
+	ppr_vec_percentage((int8*)&pprptr->ppr_bw, ppr_pwrs_size(pprptr->ch_bw), val);
 }
 
 
@@ -1734,19 +1957,9 @@ ppr_multiply_percentage(ppr_t* pprptr, uint8 val)
 void
 ppr_compare_min(ppr_t* p1, ppr_t* p2)
 {
-	uint i;
-	int8* rptr1 = NULL;
-	int8* rptr2 = NULL;
-	uint32 pprsize = 0;
-
 	if (p1->ch_bw == p2->ch_bw) {
-		rptr1 = (int8*)&p1->ppr_bw;
-		rptr2 = (int8*)&p2->ppr_bw;
-		pprsize = ppr_pwrs_size(p1->ch_bw);
-	}
-
-	for (i = 0; i < pprsize; i++, rptr1++, rptr2++) {
-		*rptr1 = MIN(*rptr1, *rptr2);
+		ppr_vec_min((int8*)&p1->ppr_bw, (const int8*)&p2->ppr_bw,
+			ppr_pwrs_size(p1->ch_bw));
 	}
 }
 
@@ -1757,19 +1970,9 @@ ppr_compare_min(ppr_t* p1, ppr_t* p2)
 void
 ppr_compare_max(ppr_t* p1, ppr_t* p2)
 {
-	uint i;
-	int8* rptr1 = NULL;
-	int8* rptr2 = NULL;
-	uint32 pprsize = 0;
-
 	if (p1->ch_bw == p2->ch_bw) {
-		rptr1 = (int8*)&p1->ppr_bw;
-		rptr2 = (int8*)&p2->ppr_bw;
-		pprsize = ppr_pwrs_size(p1->ch_bw);
-	}
-
-	for (i = 0; i < pprsize; i++, rptr1++, rptr2++) {
-		*rptr1 = MAX(*rptr1, *rptr2);
+		ppr_vec_max((int8*)&p1->ppr_bw, (const int8*)&p2->ppr_bw,
+			ppr_pwrs_size(p1->ch_bw));
 	}
 }
 
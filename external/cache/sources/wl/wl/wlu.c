@@ -692,6 +692,9 @@ static char *buf = (char*) &bufstruct_wlu.bufdata;
 /* integer output format, default to signed integer */
 static uint8 int_fmt;
 
+/* emit one JSON object per record for the hot query commands */
+static bool json_out;
+
 #ifndef ATE_BUILD
 /*
  * Country names and abbreviations from ISO 3166
@@ -3401,6 +3404,7 @@ void
 wl_cmd_init(void)
 {
 	int_fmt = INT_FMT_DEC;
+	json_out = FALSE;
 }
 
 
@@ -3414,6 +3418,7 @@ wlu_init(void)
 	 * first time that the driver is initialized vs subsequent initializations.
 	 */
 	int_fmt = INT_FMT_DEC;
+	json_out = FALSE;
 	batch_in_client = FALSE;
 	init_cmd_batchingmode();
 }
@@ -3482,6 +3487,10 @@ wl_option(char ***pargv, char **pifname, int *phelp)
 		else if (!strcmp(*argv, "-x"))
 			int_fmt = INT_FMT_HEX;
 
+		/* machine readable output */
+		else if (!strcmp(*argv, "--json"))
+			json_out = TRUE;
+
 		/* command usage */
 		else if (!strcmp(*argv, "-h") || !strcmp(*argv, "--help"))
 			help = TRUE;
@@ -3616,7 +3625,9 @@ wl_cmds_usage(FILE *fid, cmd_t *port_cmds)
 void
 wl_usage(FILE *fid, cmd_t *port_cmds)
 {
-	fprintf(fid, "Usage: %s [-a|i <adapter>] [-h] [-d|u|x] <command> [arguments]\n", wlu_av0);
+	fprintf(fid, "Usage: %s [-a|i <adapter>] [-h] [-d|u|x] [--json] <command> [arguments]\n",
+	        wlu_av0);
+	fprintf(fid, "       %s [-a|i <adapter>] --batch | --listen <socket>\n", wlu_av0);
 
 	fprintf(fid, "\n");
 	fprintf(fid, "  -h        this message and command descriptions\n");
@@ -3625,6 +3636,9 @@ wl_usage(FILE *fid, cmd_t *port_cmds)
 	fprintf(fid, "  -d        output format signed integer\n");
 	fprintf(fid, "  -u        output format unsigned integer\n");
 	fprintf(fid, "  -x        output format hexdecimal\n");
+	fprintf(fid, "  --json    one JSON object per BSS / counters record\n");
+	fprintf(fid, "  --batch   run commands read from stdin, one per line\n");
+	fprintf(fid, "  --listen  run commands read from clients of a unix socket\n");
 	fprintf(fid, "\n");
 
 	wl_cmds_usage(fid, port_cmds);
@@ -13329,6 +13343,70 @@ wl_dump_wps(uint8* cp, uint len)
 	}
 }
 
+/* Print an SSID as a JSON string, escaping quotes and non-printables */
+static void
+wl_json_ssid(uint8 *ssid, int ssid_len)
+{
+	int i, c;
+
+	if (ssid_len > 32) ssid_len = 32;
+
+	putchar('"');
+	for (i = 0; i < ssid_len; i++) {
+		c = (int)ssid[i];
+		if (c == '"' || c == '\\')
+			printf("\\%c", c);
+		else if (c >= 0x20 && c < 0x7f)
+			putchar(c);
+		else
+			printf("\\u%04x", c);
+	}
+	putchar('"');
+}
+
+/* Single line form of dump_bss_info() for scripts; chanspec already converted */
+static void
+dump_bss_info_json(wl_bss_info_t *bi)
+{
+	char chspec_str[CHANSPEC_STR_LEN];
+	uint i, r, count;
+
+	printf("{\"ssid\":");
+	wl_json_ssid(bi->SSID, bi->SSID_len);
+	printf(",\"bssid\":\"%s\"", wl_ether_etoa(&bi->BSSID));
+	printf(",\"mode\":\"%s\"", capmode2str(dtoh16(bi->capability)));
+	printf(",\"rssi\":%d", (int16)(dtoh16(bi->RSSI)));
+	if (dtoh32(bi->version) == WL_BSS_INFO_VERSION)
+		printf(",\"snr\":%d", (int16)(dtoh16(bi->SNR)));
+	printf(",\"noise\":%d", bi->phy_noise);
+	printf(",\"chanspec\":\"%s\"", wf_chspec_ntoa(bi->chanspec, chspec_str));
+	printf(",\"channel\":%d,\"band\":\"%s\",\"bw\":%d",
+	       CHSPEC_CHANNEL(bi->chanspec), CHSPEC_IS2G(bi->chanspec) ? "2.4" : "5",
+#ifdef D11AC_IOTYPES
+	       CHSPEC_IS80(bi->chanspec) ? 80 :
+#endif
+	       CHSPEC_IS40(bi->chanspec) ? 40 : (CHSPEC_IS20(bi->chanspec) ? 20 : 10));
+	printf(",\"capability\":%u,\"flags\":%u",
+	       dtoh16(bi->capability), dtoh16(bi->flags));
+
+	/* rates in 500 Kbps units, basic rate bit stripped */
+	printf(",\"rates\":[");
+	count = MIN(dtoh32(bi->rateset.count), sizeof(bi->rateset.rates));
+	for (i = 0; i < count; i++) {
+		r = bi->rateset.rates[i] & 0x7f;
+		if (r == 0)
+			break;
+		printf("%s%u", i ? "," : "", r);
+	}
+	printf("]");
+
+	if (dtoh32(bi->version) != LEGACY_WL_BSS_INFO_VERSION)
+		printf(",\"primary\":%d,\"ht\":%s,\"vht\":%s", bi->ctl_ch,
+		       bi->n_cap ? "true" : "false",
+		       (bi->n_cap && bi->vht_cap) ? "true" : "false");
+	printf("}\n");
+}
+
 void
 dump_bss_info(wl_bss_info_t *bi)
 {
@@ -13351,6 +13429,11 @@ dump_bss_info(wl_bss_info_t *bi)
 		bi->chanspec = wl_chspec_from_driver(bi->chanspec);
 	}
 
+	if (json_out) {
+		dump_bss_info_json(bi);
+		return;
+	}
+
 	wl_format_ssid(ssidbuf, bi->SSID, bi->SSID_len);
 
 	printf("SSID: \"%s\"\n", ssidbuf);
@@ -22969,6 +23052,75 @@ wl_rand(void *wl, cmd_t *cmd, char **argv)
 #define WL_CNT_VERSION_SIX 6
 #define WL_CNT_VERSION_SEVEN 7
 
+/* Parse a counter value, either "123" or the "idx(123)" form used for arrays */
+static bool
+wl_counter_val(const char *tok, long long *val)
+{
+	char *end;
+
+	*val = strtoll(tok, &end, 10);
+	if (end == tok)
+		return FALSE;
+	if (*end == '(') {
+		tok = end + 1;
+		*val = strtoll(tok, &end, 10);
+		if (end == tok || strcmp(end, ")"))
+			return FALSE;
+	}
+	return *end == '\0' || *end == ')';
+}
+
+/* Re-emit the "name value name value ..." text built by the counter dumpers
+ * as a single JSON object.  A name ending in ':' introduces an array that
+ * runs until the next name; consecutive names are joined with '_'.
+ */
+static void
+wl_counters_json(char *text)
+{
+	char key[64];
+	char *tok, *save = NULL;
+	long long val;
+	bool first = TRUE, in_array = FALSE, first_elem = TRUE;
+	size_t len;
+
+	key[0] = '\0';
+	printf("{");
+	for (tok = strtok_r(text, " \t\n", &save); tok; tok = strtok_r(NULL, " \t\n", &save)) {
+		if (wl_counter_val(tok, &val)) {
+			if (in_array) {
+				printf("%s%lld", first_elem ? "" : ",", val);
+				first_elem = FALSE;
+			} else if (key[0]) {
+				printf("%s\"%s\":%lld", first ? "" : ",", key, val);
+				first = FALSE;
+				key[0] = '\0';
+			}
+			continue;
+		}
+		if (in_array) {
+			printf("]");
+			in_array = FALSE;
+		}
+		len = strlen(key);
+		if (len && len < sizeof(key) - 1)
+			key[len++] = '_';
+		strncpy(key + len, tok, sizeof(key) - len - 1);
+		key[sizeof(key) - 1] = '\0';
+		len = strlen(key);
+		if (key[len - 1] == ':') {
+			key[len - 1] = '\0';
+			printf("%s\"%s\":[", first ? "" : ",", key);
+			first = FALSE;
+			in_array = TRUE;
+			first_elem = TRUE;
+			key[0] = '\0';
+		}
+	}
+	if (in_array)
+		printf("]");
+	printf("}\n");
+}
+
 static int
 wl_counters5(void *ptr)
 {
@@ -23065,6 +23217,12 @@ wl_counters5(void *ptr)
 		PRVAL(pktengrxducast); PRVAL(pktengrxdmcast); PRNL();
 	}
 
+	if (json_out) {
+		wl_counters_json(buf);
+		free(cnt);
+		return 0;
+	}
+
 	pbuf = buf;
 	len = strlen(buf);
 	for (i = 0; i < len; i++) {
@@ -23111,11 +23269,13 @@ wl_counters(void *wl, cmd_t *cmd, char **argv)
 		return -1;
 	}
 	else if (ver == WL_CNT_VERSION_FIVE) {
-		printf("\tUse version 5 counters struct\n");
+		if (!json_out)
+			printf("\tUse version 5 counters struct\n");
 		return wl_counters5(ptr);
 	}
 	else if (ver == WL_CNT_VERSION_SIX) {
-		printf("\t wl counters will use version 6 counters struct\n");
+		if (!json_out)
+			printf("\t wl counters will use version 6 counters struct\n");
 		cnt_six = (wl_cnt_ver_six_t*)malloc(sizeof(wl_cnt_ver_six_t));
 		if (cnt_six == NULL) {
 			printf("\tCan not allocate %d bytes for counters six struct\n",
@@ -23124,7 +23284,8 @@ wl_counters(void *wl, cmd_t *cmd, char **argv)
 		} else
 			memcpy(cnt_six, statsbuf, sizeof(wl_cnt_ver_six_t));		
 	} else if (ver == WL_CNT_VERSION_SEVEN) {
-		printf("\t wl counters will use version 7 counters struct\n");
+		if (!json_out)
+			printf("\t wl counters will use version 7 counters struct\n");
 		cnt_seven = (wl_cnt_ver_seven_t*)malloc(sizeof(wl_cnt_ver_seven_t));
 		if (cnt_seven == NULL) {
 			printf("\tCan not allocate %d bytes for counters seven struct\n",
@@ -23287,7 +23448,10 @@ wl_counters(void *wl, cmd_t *cmd, char **argv)
 	}
 
 	pbuf += sprintf(pbuf, "\n");
-	fputs(buf, stdout);
+	if (json_out)
+		wl_counters_json(buf);
+	else
+		fputs(buf, stdout);
 exit:
 	if (cnt)
 		free(cnt);
@@ -18,6 +18,7 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
+#include <sys/un.h>
 #include <net/if.h>
 #include <proto/ethernet.h>
 #include <proto/bcmip.h>
@@ -58,6 +59,7 @@ typedef u_int8_t __u8;
 /* Function prototypes */
 static cmd_t *wl_find_cmd(char* name);
 static int do_interactive(struct ifreq *ifr);
+static int do_batch(struct ifreq *ifr, char *sock_path);
 static int wl_do_cmd(struct ifreq *ifr, char **argv);
 int process_args(struct ifreq* ifr, char **argv);
 extern int g_child_pid;
@@ -72,6 +74,15 @@ unsigned short g_rwl_servport;
 char *g_rwl_servIP = NULL;
 unsigned short defined_debug = DEBUG_ERR | DEBUG_INFO;
 static uint interactive_flag = 0;
+static uint batch_flag = 0;
+static char *batch_sock_path = NULL;
+/* ioctl socket, opened on first use and kept for the life of the process */
+static int wl_ioctl_sock = -1;
+/* wl_cmds sorted by name for bsearch, built on the first lookup of a
+ * batch or interactive session; one-shot runs walk the table instead
+ */
+static cmd_t **wl_cmd_index = NULL;
+static int wl_cmd_index_len = 0;
 extern char *remote_vista_cmds[];
 extern char g_rem_ifname[IFNAMSIZ];
 static void
@@ -88,10 +99,9 @@ wl_ioctl(void *wl, int cmd, void *buf, int len, bool set)
 	struct ifreq *ifr = (struct ifreq *) wl;
 	wl_ioctl_t ioc;
 	int ret = 0;
-	int s;
 
-	/* open socket to kernel */
-	if ((s = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+	/* open socket to kernel; batch mode issues many ioctls, so keep it */
+	if (wl_ioctl_sock < 0 && (wl_ioctl_sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
 		syserr("socket");
 
 	/* do it */
@@ -100,14 +110,12 @@ wl_ioctl(void *wl, int cmd, void *buf, int len, bool set)
 	ioc.len = len;
 	ioc.set = set;
 	ifr->ifr_data = (caddr_t) &ioc;
-	if ((ret = ioctl(s, SIOCDEVPRIVATE, ifr)) < 0) {
+	if ((ret = ioctl(wl_ioctl_sock, SIOCDEVPRIVATE, ifr)) < 0) {
 		if (cmd != WLC_GET_MAGIC) {
 			ret = IOCTL_ERROR;
 		}
 	}
 
-	/* cleanup */
-	close(s);
 	return ret;
 }
 
@@ -494,8 +502,34 @@ main(int argc, char **argv)
 		interactive_flag = 1;
 	}
 
+	/* Batch mode: commands from stdin, or from clients of a unix socket.
+	 * Usage: --batch | --listen <socket path>
+	 */
+	if (*argv && strcmp(*argv, "--batch") == 0) {
+		(void)*argv++;
+		batch_flag = 1;
+	} else if (*argv && strcmp(*argv, "--listen") == 0) {
+		(void)*argv++;
+		if (!*argv) {
+			fprintf(stderr, "%s: expected socket path after --listen\n", wlu_av0);
+			return USAGE_ERROR;
+		}
+		batch_sock_path = *argv++;
+		batch_flag = 1;
+	}
+
 	/* Process for local wl */
 	if (remote_type == NO_REMOTE) {
+		if (batch_flag == 1) {
+			/* resolve the adapter once for the whole session */
+			if (!*ifr.ifr_name)
+				wl_find(&ifr);
+			if (!*ifr.ifr_name || wl_check((void *)&ifr) < 0) {
+				fprintf(stderr, "%s: wl driver adapter not found\n", wlu_av0);
+				exit(1);
+			}
+			return do_batch(&ifr, batch_sock_path);
+		}
 		if (interactive_flag == 1)
 			(void)*argv--;
 		err = process_args(&ifr, argv);
@@ -519,6 +553,9 @@ main(int argc, char **argv)
 		return err;
 	}
 
+	if (batch_flag == 1)
+		return do_batch(&ifr, batch_sock_path);
+
 	if ((*argv) && (interactive_flag == 0)) {
 		err = process_args(&ifr, argv);
 		if ((err == SERIAL_PORT_ERR) && (remote_type == REMOTE_DONGLE)) {
@@ -706,6 +743,35 @@ process_args(struct ifreq* ifr, char **argv)
 	return err;
 }
 
+/* Split an interactive/batch input line into argv, which must hold
+ * INTERACTIVE_NUM_ARGS entries.  Returns argc, or -1 if there are too many args.
+ */
+static int
+line_to_args(char *line, char **argv)
+{
+	int argc = 0;
+	char *token;
+
+	while (argc < (INTERACTIVE_NUM_ARGS - 1) &&
+	       (token = strtok(argc ? NULL : line, " \t\r\n")) != NULL) {
+
+		/* Specifically make sure empty arguments (like SSID) are empty */
+		if (token[0] == '"' && token[1] == '"') {
+		    token[0] = '\0';
+		}
+
+		argv[argc++] = token;
+	}
+	argv[argc] = NULL;
+	if (argc == (INTERACTIVE_NUM_ARGS - 1) &&
+	    (token = strtok(NULL, " \t")) != NULL) {
+		printf("wl:error: too many args; argc must be < %d\n",
+		       (INTERACTIVE_NUM_ARGS - 1));
+		return -1;
+	}
+	return argc;
+}
+
 /* Function called for 'local' interactive session and for 'remote' interactive session */
 static int
 do_interactive(struct ifreq *ifr)
@@ -731,27 +797,9 @@ do_interactive(struct ifreq *ifr)
 		if (strlen (line) > 0) {
 			/* skip past first arg if it's "wl" and parse up arguments */
 			char *argv[INTERACTIVE_NUM_ARGS];
-			int argc;
-			char *token;
-			argc = 0;
-
-			while (argc < (INTERACTIVE_NUM_ARGS - 1) &&
-			       (token = strtok(argc ? NULL : line, " \t\n")) != NULL) {
 
-				/* Specifically make sure empty arguments (like SSID) are empty */
-				if (token[0] == '"' && token[1] == '"') {
-				    token[0] = '\0';
-				}
-
-				argv[argc++] = token;
-			}
-			argv[argc] = NULL;
-			if (argc == (INTERACTIVE_NUM_ARGS - 1) &&
-			    (token = strtok(NULL, " \t")) != NULL) {
-				printf("wl:error: too many args; argc must be < %d\n",
-				       (INTERACTIVE_NUM_ARGS - 1));
+			if (line_to_args(line, argv) < 0)
 				continue;
-			}
 #ifdef RWL_WIFI
 		if (!strcmp(argv[0], "findserver")) {
 			remote_wifi_ser_init_cmds((void *) ifr);
@@ -816,6 +864,107 @@ do_interactive(struct ifreq *ifr)
 	return err;
 }
 
+/* Run commands read from fp until EOF or "q"/"exit".  The output of each
+ * command is terminated by an "@end <status>" line so that a script can
+ * frame replies without knowing the output format of every command.
+ */
+static int
+batch_session(struct ifreq *ifr, FILE *fp)
+{
+	char line[INTERACTIVE_MAX_INPUT_LENGTH];
+	char *argv[INTERACTIVE_NUM_ARGS];
+	int argc;
+	int err = 0;
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if ((argc = line_to_args(line, argv)) < 0) {
+			err = USAGE_ERROR;
+		} else if (argc == 0 || argv[0][0] == '#') {
+			continue;
+		} else if (strcmp(argv[0], "q") == 0 || strcmp(argv[0], "exit") == 0) {
+			break;
+		} else {
+			/* output format options apply to this line only */
+			wl_cmd_init();
+			err = wl_do_cmd(ifr, argv);
+		}
+		fflush(stderr);
+		printf("@end %d\n", err);
+		fflush(stdout);
+	}
+
+	return err;
+}
+
+/* Batch mode.  The adapter and ioctl socket stay open across commands and
+ * command lookups go through the sorted index, so a monitoring script pays
+ * neither process startup nor wl_find() per query.  Without a socket path
+ * commands come from stdin; otherwise clients of the unix socket are served
+ * one at a time, with stdout/stderr redirected to the client.
+ */
+static int
+do_batch(struct ifreq *ifr, char *sock_path)
+{
+	struct sockaddr_un addr;
+	int s, c, out_fd, err_fd;
+	FILE *fp;
+
+	if (!sock_path)
+		return batch_session(ifr, stdin);
+
+	if (strlen(sock_path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "%s: socket path too long: %s\n", wlu_av0, sock_path);
+		return USAGE_ERROR;
+	}
+
+	if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		syserr("socket");
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, sock_path);
+	unlink(sock_path);
+	if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		syserr("bind");
+	if (listen(s, 4) < 0)
+		syserr("listen");
+
+	/* a client hanging up mid-reply must not take the daemon down */
+	signal(SIGPIPE, SIG_IGN);
+
+	if ((out_fd = dup(STDOUT_FILENO)) < 0 || (err_fd = dup(STDERR_FILENO)) < 0)
+		syserr("dup");
+
+	while (1) {
+		if ((c = accept(s, NULL, NULL)) < 0) {
+			if (errno == EINTR)
+				continue;
+			syserr("accept");
+		}
+		if (!(fp = fdopen(c, "r"))) {
+			close(c);
+			continue;
+		}
+
+		fflush(stdout);
+		fflush(stderr);
+		dup2(c, STDOUT_FILENO);
+		dup2(c, STDERR_FILENO);
+
+		batch_session(ifr, fp);
+
+		fflush(stdout);
+		fflush(stderr);
+		dup2(out_fd, STDOUT_FILENO);
+		dup2(err_fd, STDERR_FILENO);
+		clearerr(stdout);
+		clearerr(stderr);
+		fclose(fp);
+	}
+
+	return 0;
+}
+
 /*
  * find command in argv and execute it
  * Won't handle changing ifname yet, expects that to happen with the --interactive
@@ -880,6 +1029,54 @@ wl_do_cmd(struct ifreq *ifr, char **argv)
 	return err;
 }
 
+/* Order by name; duplicate names keep their wl_cmds table order */
+static int
+wl_cmd_sort_cmp(const void *a, const void *b)
+{
+	cmd_t *ca = *(cmd_t * const *)a;
+	cmd_t *cb = *(cmd_t * const *)b;
+	int ret;
+
+	if ((ret = strcmp(ca->name, cb->name)) != 0)
+		return ret;
+	return (ca < cb) ? -1 : (ca > cb);
+}
+
+static int
+wl_cmd_key_cmp(const void *key, const void *elt)
+{
+	return strcmp((const char *)key, (*(cmd_t * const *)elt)->name);
+}
+
+/* Build the sorted command index.  Only the first entry of a duplicated
+ * name is kept, matching what the linear table walk returns.
+ * On allocation failure wl_cmd_index stays NULL and lookups fall back
+ * to the linear walk.
+ */
+static void
+wl_build_cmd_index(void)
+{
+	cmd_t *cmd;
+	int n, i, j;
+
+	for (cmd = wl_cmds, n = 0; cmd->name; cmd++)
+		n++;
+
+	/* mark the index as attempted even if the allocation fails */
+	wl_cmd_index_len = -1;
+	if (!(wl_cmd_index = malloc(n * sizeof(cmd_t *))))
+		return;
+
+	for (i = 0; i < n; i++)
+		wl_cmd_index[i] = &wl_cmds[i];
+	qsort(wl_cmd_index, n, sizeof(cmd_t *), wl_cmd_sort_cmp);
+
+	for (i = 0, j = 0; i < n; i++)
+		if (j == 0 || strcmp(wl_cmd_index[j - 1]->name, wl_cmd_index[i]->name))
+			wl_cmd_index[j++] = wl_cmd_index[i];
+	wl_cmd_index_len = j;
+}
+
 /* Search the wl_cmds table for a matching command name.
  * Return the matching command or NULL if no match found.
  */
@@ -887,6 +1084,17 @@ static cmd_t *
 wl_find_cmd(char* name)
 {
 	cmd_t *cmd = NULL;
+	cmd_t **found;
+
+	/* a single lookup is cheaper than sorting the whole table */
+	if (wl_cmd_index_len == 0 && (batch_flag || interactive_flag))
+		wl_build_cmd_index();
+
+	if (wl_cmd_index) {
+		found = bsearch(name, wl_cmd_index, wl_cmd_index_len, sizeof(cmd_t *),
+		                wl_cmd_key_cmp);
+		return found ? *found : NULL;
+	}
 
 	/* search the wl_cmds for a matching name */
 	for (cmd = wl_cmds; cmd->name && strcmp(cmd->name, name); cmd++);